@@ -0,0 +1,182 @@
+/*
+ * Bitmap search microbenchmark.
+ *
+ * Usage: bench_bitmap [num_iterations_in_millions]
+ *
+ * Runs pet_allocator bitmap searches over a set of page bitmaps with random
+ * free runs, for 4K pages and 16-byte units, and compares:
+ *
+ *   runtime   bitset functions that take the bitmap size at runtime
+ *   words     word-level inline functions with the number of words at runtime
+ *   fixed     the same with constant number of words, as pet_allocator
+ *             does when built with PET_PAGE_SIZE
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "timespec.h"
+
+#define PAGE_SIZE     4096
+#define UNIT_SIZE     16
+#define PAGE_BITS     (PAGE_SIZE / UNIT_SIZE)
+#define HEADER_UNITS  4
+#define NUM_BITMAPS   1024
+
+static Word bitmaps[NUM_BITMAPS][PAGE_BITS / WORD_WIDTH];
+
+static double elapsed(struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    timespec_sub(&now, start);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static uint64_t rng_state = 88172645463325252UL;
+
+static inline uint64_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static void init_bitmaps()
+/*
+ * Alternating used and free runs, mostly short ones, like a page after some churn.
+ */
+{
+    for (unsigned i = 0; i < NUM_BITMAPS; i++) {
+        memset(bitmaps[i], 0, sizeof(bitmaps[i]));
+        bitset_set_range(bitmaps[i], 0, HEADER_UNITS);
+        unsigned offset = HEADER_UNITS;
+        bool used = true;
+        while (offset < PAGE_BITS) {
+            unsigned length = 1 + next_random() % ((next_random() % 8)? 8 : 64);
+            if (length > PAGE_BITS - offset) {
+                length = PAGE_BITS - offset;
+            }
+            if (used) {
+                bitset_set_range(bitmaps[i], offset, length);
+            }
+            offset += length;
+            used = !used;
+        }
+    }
+}
+
+typedef unsigned (*FnSearch)(Word* bitset, unsigned num_bits, unsigned arg);
+
+/*
+ * Searches with runtime bitmap size, `num_bits` is opaque to the compiler.
+ */
+
+static unsigned runtime_first_fit(Word* bitset, unsigned num_bits, unsigned length)
+{
+    return bitset_find_zeros(bitset, num_bits, HEADER_UNITS, length);
+}
+
+static unsigned runtime_best_fit(Word* bitset, unsigned num_bits, unsigned length)
+{
+    return bitset_find_best_zeros(bitset, num_bits, HEADER_UNITS, length);
+}
+
+static unsigned runtime_longest(Word* bitset, unsigned num_bits, unsigned unused)
+{
+    return bitset_longest_zeros(bitset, num_bits, HEADER_UNITS);
+}
+
+/*
+ * Word-level searches with runtime number of words.
+ */
+
+static unsigned words_first_fit(Word* bitset, unsigned num_bits, unsigned length)
+{
+    return bitset_find_zeros_words(bitset, num_bits / WORD_WIDTH, HEADER_UNITS, length);
+}
+
+static unsigned words_best_fit(Word* bitset, unsigned num_bits, unsigned length)
+{
+    return bitset_find_best_zeros_words(bitset, num_bits / WORD_WIDTH, HEADER_UNITS, length);
+}
+
+static unsigned words_longest(Word* bitset, unsigned num_bits, unsigned unused)
+{
+    return bitset_longest_zeros_words(bitset, num_bits / WORD_WIDTH, HEADER_UNITS);
+}
+
+/*
+ * Word-level searches specialized for constant bitmap size, `num_bits` argument is ignored.
+ */
+
+static unsigned fixed_first_fit(Word* bitset, unsigned num_bits, unsigned length)
+{
+    return bitset_find_zeros_words(bitset, PAGE_BITS / WORD_WIDTH, HEADER_UNITS, length);
+}
+
+static unsigned fixed_best_fit(Word* bitset, unsigned num_bits, unsigned length)
+{
+    return bitset_find_best_zeros_words(bitset, PAGE_BITS / WORD_WIDTH, HEADER_UNITS, length);
+}
+
+static unsigned fixed_longest(Word* bitset, unsigned num_bits, unsigned unused)
+{
+    return bitset_longest_zeros_words(bitset, PAGE_BITS / WORD_WIDTH, HEADER_UNITS);
+}
+
+static double run(FnSearch search, unsigned num_bits, unsigned num_iterations, unsigned* checksum)
+{
+    unsigned sum = 0;
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < num_iterations; i++) {
+        sum += search(bitmaps[i % NUM_BITMAPS], num_bits, 1 + (i & 7) * (i & 3));
+    }
+    double t = elapsed(&start);
+    *checksum = sum;
+    return t / num_iterations * 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned num_iterations = ((argc > 1)? strtoul(argv[1], nullptr, 10) : 20) * 1'000'000;
+
+    // keep the size opaque for runtime versions
+    unsigned num_bits = (argc > 2)? strtoul(argv[2], nullptr, 10) : PAGE_BITS;
+    if (num_bits != PAGE_BITS) {
+        fprintf(stderr, "bitmap size must be %u\n", PAGE_BITS);
+        return 1;
+    }
+    init_bitmaps();
+
+    struct {
+        char* name;
+        FnSearch runtime;
+        FnSearch words;
+        FnSearch fixed;
+    } searches[] = {
+        { "first fit", runtime_first_fit, words_first_fit, fixed_first_fit },
+        { "best fit",  runtime_best_fit,  words_best_fit,  fixed_best_fit },
+        { "longest",   runtime_longest,   words_longest,   fixed_longest }
+    };
+
+    printf("%u iterations, %u-bit bitmaps, ns per search\n", num_iterations, PAGE_BITS);
+    printf("%-10s %8s %8s %8s %8s\n", "", "runtime", "words", "fixed", "speedup");
+    for (unsigned i = 0; i < sizeof(searches) / sizeof(searches[0]); i++) {
+        unsigned checksum_runtime, checksum_words, checksum_fixed;
+        double t_runtime = run(searches[i].runtime, num_bits, num_iterations, &checksum_runtime);
+        double t_words = run(searches[i].words, num_bits, num_iterations, &checksum_words);
+        double t_fixed = run(searches[i].fixed, num_bits, num_iterations, &checksum_fixed);
+        if (checksum_runtime != checksum_words || checksum_runtime != checksum_fixed) {
+            fprintf(stderr, "%s: results differ\n", searches[i].name);
+            return 1;
+        }
+        printf("%-10s %8.1f %8.1f %8.1f %7.2fx\n",
+               searches[i].name, t_runtime, t_words, t_fixed, t_runtime / t_fixed);
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * STL containers benchmark.
+ *
+ * Usage: bench_containers [num_items_in_thousands]
+ *
+ * Runs the same workload on containers with default new/delete,
+ * with pussy::StlAllocator and with pmr containers over pussy::MemoryResource,
+ * the latter two backed by the default allocator, see allocator_config.h.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+
+#include "allocator.hpp"
+#include "allocator_config.h"
+#include "timespec.h"
+
+static double elapsed(struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    timespec_sub(&now, start);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static std::uint64_t next_key(std::uint64_t& x)
+{
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+template <typename Vector>
+static double vector_push_back(Vector& v, unsigned n)
+{
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned r = 0; r < 10; r++) {
+        v.clear();
+        v.shrink_to_fit();
+        for (unsigned i = 0; i < n; i++) {
+            v.push_back(i);
+        }
+    }
+    return elapsed(&start) / 10;
+}
+
+template <typename List>
+static double list_churn(List& l, unsigned n)
+{
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        l.push_back(i);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        // free every other node and allocate again
+        l.pop_front();
+        l.push_back(i);
+        l.pop_front();
+    }
+    l.clear();
+    return elapsed(&start);
+}
+
+template <typename Map>
+static double map_insert_erase(Map& m, unsigned n)
+{
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    std::uint64_t x = 88172645463325252UL;
+    for (unsigned i = 0; i < n; i++) {
+        m.emplace(next_key(x), i);
+    }
+    x = 88172645463325252UL;
+    for (unsigned i = 0; i < n; i++) {
+        m.erase(next_key(x));
+    }
+    return elapsed(&start);
+}
+
+static void report(const char* workload, double t_new, double t_stl, double t_pmr, unsigned n)
+{
+    std::printf("%-20s %8.1f %8.1f %8.1f\n", workload, t_new / n * 1e9, t_stl / n * 1e9, t_pmr / n * 1e9);
+}
+
+int main(int argc, char* argv[])
+{
+    init_allocator_from_env(&pet_allocator);
+
+    unsigned n = ((argc > 1)? std::strtoul(argv[1], nullptr, 10) : 1000) * 1000;
+
+    pussy::MemoryResource resource(&default_allocator);
+    pussy::StlAllocator<int> stl_allocator(&default_allocator);
+
+    std::printf("%u items, ns per item\n", n);
+    std::printf("%-20s %8s %8s %8s\n", "", "new", "stl", "pmr");
+
+    {
+        std::vector<unsigned> v_new;
+        std::vector<unsigned, pussy::StlAllocator<unsigned>> v_stl(stl_allocator);
+        std::pmr::vector<unsigned> v_pmr(&resource);
+        report("vector push_back", vector_push_back(v_new, n), vector_push_back(v_stl, n),
+               vector_push_back(v_pmr, n), n);
+    }
+    {
+        std::list<unsigned> l_new;
+        std::list<unsigned, pussy::StlAllocator<unsigned>> l_stl(stl_allocator);
+        std::pmr::list<unsigned> l_pmr(&resource);
+        report("list churn", list_churn(l_new, n), list_churn(l_stl, n), list_churn(l_pmr, n), n);
+    }
+    {
+        using Pair = std::pair<const std::uint64_t, unsigned>;
+        std::map<std::uint64_t, unsigned> m_new;
+        std::map<std::uint64_t, unsigned, std::less<>, pussy::StlAllocator<Pair>> m_stl(stl_allocator);
+        std::pmr::map<std::uint64_t, unsigned> m_pmr(&resource);
+        report("map insert/erase", map_insert_erase(m_new, n), map_insert_erase(m_stl, n),
+               map_insert_erase(m_pmr, n), n);
+    }
+    {
+        using Pair = std::pair<const std::uint64_t, unsigned>;
+        std::unordered_map<std::uint64_t, unsigned> u_new;
+        std::unordered_map<std::uint64_t, unsigned, std::hash<std::uint64_t>, std::equal_to<>,
+                           pussy::StlAllocator<Pair>> u_stl(stl_allocator);
+        std::pmr::unordered_map<std::uint64_t, unsigned> u_pmr(&resource);
+        report("unordered_map", map_insert_erase(u_new, n), map_insert_erase(u_stl, n),
+               map_insert_erase(u_pmr, n), n);
+    }
+    return 0;
+}
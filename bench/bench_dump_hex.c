@@ -0,0 +1,76 @@
+/*
+ * Streaming hexdump benchmark.
+ *
+ * Usage: bench_dump_hex [size_in_MB [max_threads]]
+ *
+ * Creates temporary file with pseudo-random data and runs of same rows,
+ * then dumps it to /dev/null with 1..max_threads threads and prints throughput.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "allocator_config.h"
+#include "dump.h"
+#include "timespec.h"
+
+static double elapsed(struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    timespec_sub(&now, start);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    init_allocator_from_env(&pet_allocator);
+
+    size_t size = ((argc > 1)? strtoul(argv[1], nullptr, 10) : 256) * 1024 * 1024;
+    unsigned max_threads = (argc > 2)? strtoul(argv[2], nullptr, 10) : (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+
+    char filename[] = "/tmp/bench_dump_hex.XXXXXX";
+    int fd = mkstemp(filename);
+    if (fd == -1) {
+        perror("mkstemp");
+        return 1;
+    }
+    unlink(filename);
+
+    // fill file: mostly random data with some zero runs
+    uint8_t* buffer = allocate(1024 * 1024, false);
+    uint64_t x = 88172645463325252UL;
+    for (size_t written = 0; written < size; written += 1024 * 1024) {
+        for (unsigned i = 0; i < 1024 * 1024; i += 8) {
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            memcpy(buffer + i, &x, 8);
+        }
+        // 4 KiB aligned, so the run stays within the buffer
+        memset(buffer + (x & 0xFF000), 0, 4096);
+        if (write(fd, buffer, 1024 * 1024) != 1024 * 1024) {
+            perror("write");
+            return 1;
+        }
+    }
+    release((void**) &buffer, 1024 * 1024);
+
+    FILE* devnull = fopen("/dev/null", "w");
+    printf("dump_hex_fd, %zu MB\n", size >> 20);
+    for (unsigned n = 1; n <= max_threads; n *= 2) {
+        struct timespec start;
+        timespec_get(&start, TIME_UTC);
+        if (!dump_hex_fd(devnull, fd, 0, size, true, n)) {
+            fprintf(stderr, "dump_hex_fd failed\n");
+            return 1;
+        }
+        double t = elapsed(&start);
+        printf("  %2u threads: %.3f s, %.3f GB/s\n", n, t, size / t / 1e9);
+    }
+    fclose(devnull);
+    close(fd);
+    return 0;
+}
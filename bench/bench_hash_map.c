@@ -0,0 +1,261 @@
+/*
+ * Hash map benchmark.
+ *
+ * Usage: bench_hash_map [num_items_in_millions]
+ *
+ * Compares open-addressing HashMap with plain chained map, both use the default allocator.
+ * Keys are random 64-bit numbers, time is given per operation.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "allocator_config.h"
+#include "hash_map.h"
+#include "timespec.h"
+
+static double elapsed(struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    timespec_sub(&now, start);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static inline bool equal_u64(uint64_t a, uint64_t b)
+{
+    return a == b;
+}
+
+DEFINE_HASH_MAP(MapU64, map_u64, uint64_t, uint64_t, hash_u64, equal_u64)
+
+/****************************************************************
+ * Chained map for comparison.
+ */
+
+typedef struct ChainNode ChainNode;
+
+struct ChainNode {
+    ChainNode* next;
+    uint64_t key;
+    uint64_t value;
+};
+
+typedef struct {
+    ChainNode** buckets;
+    unsigned num_buckets;
+    unsigned size;
+} ChainMap;
+
+static bool chain_map_grow(ChainMap* map)
+{
+    unsigned num_buckets = map->num_buckets? map->num_buckets * 2 : 16;
+    ChainNode** buckets = allocate(num_buckets * sizeof(ChainNode*), true);
+    if (!buckets) {
+        return false;
+    }
+    for (unsigned i = 0; i < map->num_buckets; i++) {
+        for (ChainNode* node = map->buckets[i]; node;) {
+            ChainNode* next = node->next;
+            unsigned b = hash_u64(node->key) & (num_buckets - 1);
+            node->next = buckets[b];
+            buckets[b] = node;
+            node = next;
+        }
+    }
+    if (map->buckets) {
+        release((void**) &map->buckets, map->num_buckets * sizeof(ChainNode*));
+    }
+    map->buckets = buckets;
+    map->num_buckets = num_buckets;
+    return true;
+}
+
+static bool chain_map_put(ChainMap* map, uint64_t key, uint64_t value)
+{
+    if (map->size >= map->num_buckets && !chain_map_grow(map)) {
+        return false;
+    }
+    ChainNode** bucket = &map->buckets[hash_u64(key) & (map->num_buckets - 1)];
+    for (ChainNode* node = *bucket; node; node = node->next) {
+        if (node->key == key) {
+            node->value = value;
+            return true;
+        }
+    }
+    ChainNode* node = allocate(sizeof(ChainNode), false);
+    if (!node) {
+        return false;
+    }
+    node->key = key;
+    node->value = value;
+    node->next = *bucket;
+    *bucket = node;
+    map->size++;
+    return true;
+}
+
+static uint64_t* chain_map_get(ChainMap* map, uint64_t key)
+{
+    if (map->size == 0) {
+        return nullptr;
+    }
+    for (ChainNode* node = map->buckets[hash_u64(key) & (map->num_buckets - 1)]; node; node = node->next) {
+        if (node->key == key) {
+            return &node->value;
+        }
+    }
+    return nullptr;
+}
+
+static bool chain_map_remove(ChainMap* map, uint64_t key)
+{
+    ChainNode** prev = &map->buckets[hash_u64(key) & (map->num_buckets - 1)];
+    for (ChainNode* node = *prev; node; prev = &node->next, node = node->next) {
+        if (node->key == key) {
+            *prev = node->next;
+            release((void**) &node, sizeof(ChainNode));
+            map->size--;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void chain_map_destroy(ChainMap* map)
+{
+    for (unsigned i = 0; i < map->num_buckets; i++) {
+        for (ChainNode* node = map->buckets[i]; node;) {
+            ChainNode* next = node->next;
+            release((void**) &node, sizeof(ChainNode));
+            node = next;
+        }
+    }
+    if (map->buckets) {
+        release((void**) &map->buckets, map->num_buckets * sizeof(ChainNode*));
+    }
+    map->num_buckets = 0;
+    map->size = 0;
+}
+
+/****************************************************************
+ * Benchmark.
+ */
+
+static void report(char* map_name, char* op_name, double t, unsigned n)
+{
+    printf("%-8s %-12s %7.1f ns/op\n", map_name, op_name, t / n * 1e9);
+}
+
+int main(int argc, char* argv[])
+{
+    init_allocator_from_env(&pet_allocator);
+
+    unsigned n = ((argc > 1)? strtoul(argv[1], nullptr, 10) : 10) * 1'000'000;
+
+    // first n keys are inserted, next n are for misses
+    uint64_t* keys = allocate(2 * n * sizeof(uint64_t), false);
+    if (!keys) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    uint64_t x = 88172645463325252UL;
+    for (unsigned i = 0; i < 2 * n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        keys[i] = x;
+    }
+    printf("%u items\n", n);
+
+    struct timespec start;
+    uint64_t sum;
+
+    // HashMap
+    MapU64 map;
+    map_u64_init(&map, nullptr);
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        if (!map_u64_put(&map, keys[i], i)) {
+            fprintf(stderr, "map_u64_put failed\n");
+            return 1;
+        }
+    }
+    report("HashMap", "insert", elapsed(&start), n);
+
+    sum = 0;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        sum += *map_u64_get(&map, keys[i]);
+    }
+    report("HashMap", "lookup hit", elapsed(&start), n);
+    if (sum != (uint64_t) n * (n - 1) / 2) {
+        fprintf(stderr, "HashMap: wrong sum of values\n");
+        return 1;
+    }
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = n; i < 2 * n; i++) {
+        if (map_u64_get(&map, keys[i])) {
+            fprintf(stderr, "HashMap: unexpected hit\n");
+            return 1;
+        }
+    }
+    report("HashMap", "lookup miss", elapsed(&start), n);
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        map_u64_remove(&map, keys[i]);
+    }
+    report("HashMap", "remove", elapsed(&start), n);
+    if (map_u64_size(&map)) {
+        fprintf(stderr, "HashMap: not empty after remove\n");
+        return 1;
+    }
+    map_u64_destroy(&map);
+
+    // ChainMap
+    ChainMap chain_map = {};
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        if (!chain_map_put(&chain_map, keys[i], i)) {
+            fprintf(stderr, "chain_map_put failed\n");
+            return 1;
+        }
+    }
+    report("ChainMap", "insert", elapsed(&start), n);
+
+    sum = 0;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        sum += *chain_map_get(&chain_map, keys[i]);
+    }
+    report("ChainMap", "lookup hit", elapsed(&start), n);
+    if (sum != (uint64_t) n * (n - 1) / 2) {
+        fprintf(stderr, "ChainMap: wrong sum of values\n");
+        return 1;
+    }
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = n; i < 2 * n; i++) {
+        if (chain_map_get(&chain_map, keys[i])) {
+            fprintf(stderr, "ChainMap: unexpected hit\n");
+            return 1;
+        }
+    }
+    report("ChainMap", "lookup miss", elapsed(&start), n);
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        chain_map_remove(&chain_map, keys[i]);
+    }
+    report("ChainMap", "remove", elapsed(&start), n);
+    chain_map_destroy(&chain_map);
+
+    release((void**) &keys, 2 * n * sizeof(uint64_t));
+    return 0;
+}
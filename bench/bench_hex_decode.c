@@ -0,0 +1,90 @@
+/*
+ * Hex decoding benchmark.
+ *
+ * Usage: bench_hex_decode [size_in_MB]
+ *
+ * Measures throughput of raw hex_decode and of parse_hex_dump on dump_hex output.
+ * Throughput is given for input text.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "allocator_config.h"
+#include "dump.h"
+#include "timespec.h"
+
+static double elapsed(struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    timespec_sub(&now, start);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char* argv[])
+{
+    init_allocator_from_env(&pet_allocator);
+
+    unsigned size = ((argc > 1)? strtoul(argv[1], nullptr, 10) : 64) * 1024 * 1024;
+
+    uint8_t* data = allocate(size, false);
+    uint8_t* decoded = allocate(size, false);
+    char* text = allocate(size * 2, false);
+    if (!data || !decoded || !text) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    uint64_t x = 88172645463325252UL;
+    for (unsigned i = 0; i < size; i += 8) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        memcpy(data + i, &x, 8);
+    }
+    static char hexdigits[] = "0123456789abcdef";
+    for (unsigned i = 0; i < size; i++) {
+        text[i * 2] = hexdigits[data[i] >> 4];
+        text[i * 2 + 1] = hexdigits[data[i] & 15];
+    }
+
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < 10; i++) {
+        if (!hex_decode(decoded, text, size)) {
+            fprintf(stderr, "hex_decode failed\n");
+            return 1;
+        }
+    }
+    double t = elapsed(&start) / 10;
+    if (memcmp(data, decoded, size)) {
+        fprintf(stderr, "hex_decode mismatch\n");
+        return 1;
+    }
+    printf("hex_decode, %u MB: %.3f GB/s\n", size >> 20, size * 2 / t / 1e9);
+
+    // parse dump_hex output
+    char* dump;
+    size_t dump_length;
+    FILE* fp = open_memstream(&dump, &dump_length);
+    dump_hex(fp, 0, data, size, data, false, true);
+    fclose(fp);
+
+    timespec_get(&start, TIME_UTC);
+    unsigned parsed_size;
+    uint8_t* parsed = parse_hex_dump(dump, dump_length, &parsed_size, nullptr);
+    t = elapsed(&start);
+    if (!parsed || parsed_size != size || memcmp(data, parsed, size)) {
+        fprintf(stderr, "parse_hex_dump mismatch\n");
+        return 1;
+    }
+    printf("parse_hex_dump, %zu MB: %.3f GB/s\n", dump_length >> 20, dump_length / t / 1e9);
+
+    free(dump);
+    release((void**) &parsed, parsed_size);
+    release((void**) &text, size * 2);
+    release((void**) &decoded, size);
+    release((void**) &data, size);
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * pet_allocator placement policies benchmark.
+ *
+ * Usage: bench_pet_policies [num_ops_in_millions [num_live_blocks]]
+ *
+ * For each fit policy and page reuse order runs random allocate/release churn
+ * over a fixed set of slots with sizes served by the bitmap sub-allocator,
+ * then takes a heap snapshot and reports:
+ *
+ *   ns/op     time per allocate or release
+ *   pages     bitmap pages in use
+ *   util      requested bytes / bytes in bitmap pages
+ *   free/lfb  average free units per page / average longest free block,
+ *             the higher the ratio the more fragmented is free space
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "pet_snapshot.h"
+#include "timespec.h"
+
+static double elapsed(struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    timespec_sub(&now, start);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static uint64_t rng_state;
+
+static inline uint64_t next_random()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static unsigned random_size()
+/*
+ * Mostly small blocks with a tail of bigger ones, all below bitmap page capacity.
+ */
+{
+    unsigned r = next_random() % 100;
+    if (r < 70) {
+        return 16 + next_random() % 113;
+    } else if (r < 95) {
+        return 128 + next_random() % 897;
+    } else {
+        return 1024 + next_random() % 1977;
+    }
+}
+
+typedef struct {
+    size_t num_pages;
+    size_t used_units;
+    size_t free_units;
+    size_t sum_lfb;
+    unsigned page_size;
+} HeapShape;
+
+static bool heap_shape(HeapShape* shape)
+/*
+ * Take pet_allocator snapshot and summarize page bitmaps.
+ */
+{
+    FILE* fp = tmpfile();
+    if (!fp || !pet_snapshot(fileno(fp))) {
+        return false;
+    }
+    rewind(fp);
+    PetSnapshotHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1) {
+        fclose(fp);
+        return false;
+    }
+    memset(shape, 0, sizeof(HeapShape));
+    shape->num_pages = header.num_pages;
+    shape->page_size = header.page_size;
+
+    uint8_t bitmap[header.bitmap_size];
+    for (uint64_t i = 0; i < header.num_pages; i++) {
+        PetSnapshotPage page;
+        if (fread(&page, sizeof(page), 1, fp) != 1 || fread(bitmap, header.bitmap_size, 1, fp) != 1) {
+            fclose(fp);
+            return false;
+        }
+        unsigned used = 0;
+        for (unsigned j = 0; j < header.bitmap_size; j++) {
+            used += __builtin_popcount(bitmap[j]);
+        }
+        used -= header.header_units;
+        shape->used_units += used;
+        shape->free_units += header.units_per_page - header.header_units - used;
+        shape->sum_lfb += page.lfb;
+    }
+    fclose(fp);
+    return true;
+}
+
+static char* fit_names[] = { "first", "best", "next" };
+static char* reuse_names[] = { "fifo", "mru" };
+
+int main(int argc, char* argv[])
+{
+    unsigned num_ops = ((argc > 1)? strtoul(argv[1], nullptr, 10) : 10) * 1'000'000;
+    unsigned num_slots = (argc > 2)? strtoul(argv[2], nullptr, 10) : 200'000;
+
+    init_allocator(&pet_allocator);
+
+    void** blocks = allocate(num_slots * sizeof(void*), true);
+    unsigned* sizes = allocate(num_slots * sizeof(unsigned), true);
+    if (!blocks || !sizes) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("%u ops, %u slots\n", num_ops, num_slots);
+    printf("%-6s %-5s %8s %8s %7s %9s\n", "fit", "reuse", "ns/op", "pages", "util", "free/lfb");
+
+    for (unsigned fit = PET_FIRST_FIT; fit <= PET_NEXT_FIT; fit++) {
+        for (unsigned reuse = PET_REUSE_FIFO; reuse <= PET_REUSE_MRU; reuse++) {
+            pet_tunables.fit_policy = fit;
+            pet_tunables.page_reuse = reuse;
+            rng_state = 88172645463325252UL;
+
+            // fill half of slots
+            size_t live_bytes = 0;
+            for (unsigned i = 0; i < num_slots; i += 2) {
+                sizes[i] = random_size();
+                blocks[i] = allocate(sizes[i], false);
+                live_bytes += sizes[i];
+            }
+
+            struct timespec start;
+            timespec_get(&start, TIME_UTC);
+            for (unsigned i = 0; i < num_ops; i++) {
+                unsigned slot = next_random() % num_slots;
+                if (blocks[slot]) {
+                    release(&blocks[slot], sizes[slot]);
+                    live_bytes -= sizes[slot];
+                } else {
+                    sizes[slot] = random_size();
+                    blocks[slot] = allocate(sizes[slot], false);
+                    if (!blocks[slot]) {
+                        fprintf(stderr, "out of memory\n");
+                        return 1;
+                    }
+                    live_bytes += sizes[slot];
+                }
+            }
+            double t = elapsed(&start);
+
+            HeapShape shape;
+            if (!heap_shape(&shape)) {
+                fprintf(stderr, "cannot take snapshot\n");
+                return 1;
+            }
+            printf("%-6s %-5s %8.1f %8zu %6.1f%% %9.2f\n",
+                   fit_names[fit], reuse_names[reuse], t / num_ops * 1e9, shape.num_pages,
+                   100.0 * live_bytes / (shape.num_pages * shape.page_size),
+                   shape.sum_lfb? (double) shape.free_units / shape.sum_lfb : 0);
+
+            for (unsigned i = 0; i < num_slots; i++) {
+                release(&blocks[i], sizes[i]);
+            }
+        }
+    }
+    release((void**) &sizes, num_slots * sizeof(unsigned));
+    release((void**) &blocks, num_slots * sizeof(void*));
+    return 0;
+}
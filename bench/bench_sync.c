@@ -0,0 +1,409 @@
+/*
+ * Synchronization primitives benchmark.
+ *
+ * Usage: bench_sync [max_threads [num_rounds_in_thousands]]
+ *
+ * Runs with 1, 2, 4 ... max_threads threads:
+ *
+ *   uncontended  time per set_event, clear_event, event_is_set,
+ *                wait_event on already set event, and create/delete_event pair
+ *   ping-pong    pairs of threads bounce two events, round trip time
+ *   broadcast    one thread sets event, N waiters wake up, time from set to wakeup
+ *   timeout      N threads wait on events nobody sets, time past the timeout
+ *
+ * Latencies are given as percentiles over all rounds of all threads, in microseconds.
+ * Time is taken with timespec_get, as elsewhere in the library.
+ */
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "allocator.h"
+#include "allocator_config.h"
+#include "sync.h"
+#include "timespec.h"
+
+static double elapsed(struct timespec* start)
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    timespec_sub(&now, start);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static inline uint64_t now_ns()
+{
+    struct timespec now;
+    timespec_get(&now, TIME_UTC);
+    return now.tv_sec * 1'000'000'000ULL + now.tv_nsec;
+}
+
+/****************************************************************
+ * Latency samples.
+ */
+
+typedef struct {
+    uint64_t* ns;
+    unsigned count;
+    unsigned capacity;
+} Samples;
+
+static bool init_samples(Samples* samples, unsigned capacity)
+{
+    samples->ns = allocate(capacity * sizeof(uint64_t), false);
+    samples->count = 0;
+    samples->capacity = capacity;
+    return samples->ns;
+}
+
+static void fini_samples(Samples* samples)
+{
+    release((void**) &samples->ns, samples->capacity * sizeof(uint64_t));
+}
+
+static inline void add_sample(Samples* samples, uint64_t ns)
+{
+    if (samples->count < samples->capacity) {
+        samples->ns[samples->count++] = ns;
+    }
+}
+
+static int compare_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(Samples* samples)
+/*
+ * Print p50, p90, p99 and max in microseconds. Sorts samples.
+ */
+{
+    if (samples->count == 0) {
+        printf(" %8s %8s %8s %8s\n", "-", "-", "-", "-");
+        return;
+    }
+    qsort(samples->ns, samples->count, sizeof(uint64_t), compare_u64);
+    unsigned last = samples->count - 1;
+    printf(" %8.2f %8.2f %8.2f %8.2f\n",
+           samples->ns[last * 50 / 100] / 1e3, samples->ns[last * 90 / 100] / 1e3,
+           samples->ns[last * 99 / 100] / 1e3, samples->ns[last] / 1e3);
+}
+
+static void print_header(const char* title, const char* rate_name)
+{
+    printf("\n%s\n", title);
+    printf("%7s %10s %8s %8s %8s %8s\n", "threads", rate_name, "p50", "p90", "p99", "max");
+}
+
+static unsigned num_rounds;
+
+/****************************************************************
+ * Uncontended operations.
+ */
+
+static void bench_uncontended()
+{
+    Event* event = create_event();
+    if (!event) {
+        perror("create_event");
+        exit(1);
+    }
+    struct timespec start;
+    unsigned n = num_rounds * 100;
+    volatile bool sink;
+
+    printf("\nuncontended, ns/op\n");
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        set_event(event);
+    }
+    printf("  %-20s %8.1f\n", "set_event", elapsed(&start) / n * 1e9);
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        clear_event(event);
+    }
+    printf("  %-20s %8.1f\n", "clear_event", elapsed(&start) / n * 1e9);
+
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        sink = event_is_set(event);
+    }
+    printf("  %-20s %8.1f\n", "event_is_set", elapsed(&start) / n * 1e9);
+
+    set_event(event);
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        sink = wait_event(event, 0);
+    }
+    printf("  %-20s %8.1f\n", "wait_event (set)", elapsed(&start) / n * 1e9);
+    (void) sink;
+    delete_event(&event);
+
+    n = num_rounds * 10;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < n; i++) {
+        event = create_event();
+        delete_event(&event);
+    }
+    printf("  %-20s %8.1f\n", "create+delete_event", elapsed(&start) / n * 1e9);
+}
+
+/****************************************************************
+ * Ping-pong.
+ */
+
+typedef struct {
+    Event* ping;
+    Event* pong;
+    Samples samples;
+} PingPong;
+
+static int pong_thread(void* arg)
+{
+    PingPong* pp = arg;
+    for (unsigned i = 0; i < num_rounds; i++) {
+        wait_event(pp->ping, -1);
+        clear_event(pp->ping);
+        set_event(pp->pong);
+    }
+    return 0;
+}
+
+static int ping_thread(void* arg)
+{
+    PingPong* pp = arg;
+    for (unsigned i = 0; i < num_rounds; i++) {
+        uint64_t t = now_ns();
+        set_event(pp->ping);
+        wait_event(pp->pong, -1);
+        clear_event(pp->pong);
+        add_sample(&pp->samples, now_ns() - t);
+    }
+    return 0;
+}
+
+static void bench_ping_pong(unsigned num_threads)
+{
+    unsigned num_pairs = num_threads / 2;
+    PingPong pairs[num_pairs];
+    thrd_t threads[num_threads];
+
+    for (unsigned i = 0; i < num_pairs; i++) {
+        pairs[i].ping = create_event();
+        pairs[i].pong = create_event();
+        if (!pairs[i].ping || !pairs[i].pong || !init_samples(&pairs[i].samples, num_rounds)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < num_pairs; i++) {
+        thrd_create(&threads[2 * i], pong_thread, &pairs[i]);
+        thrd_create(&threads[2 * i + 1], ping_thread, &pairs[i]);
+    }
+    for (unsigned i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+    }
+    double t = elapsed(&start);
+
+    Samples all;
+    if (!init_samples(&all, num_pairs * num_rounds)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (unsigned i = 0; i < num_pairs; i++) {
+        for (unsigned j = 0; j < pairs[i].samples.count; j++) {
+            add_sample(&all, pairs[i].samples.ns[j]);
+        }
+        fini_samples(&pairs[i].samples);
+        delete_event(&pairs[i].ping);
+        delete_event(&pairs[i].pong);
+    }
+    printf("%7u %10.0f", num_threads, num_pairs * num_rounds / t);
+    print_percentiles(&all);
+    fini_samples(&all);
+}
+
+/****************************************************************
+ * Broadcast.
+ */
+
+typedef struct {
+    Event* go;
+    atomic_uint round;
+    atomic_uint num_woken;
+    atomic_uint_least64_t set_time;
+} Broadcast;
+
+typedef struct {
+    Broadcast* broadcast;
+    Samples samples;
+} Waiter;
+
+static int waiter_thread(void* arg)
+{
+    Waiter* waiter = arg;
+    Broadcast* bc = waiter->broadcast;
+    for (unsigned i = 0; i < num_rounds; i++) {
+        wait_event(bc->go, -1);
+        add_sample(&waiter->samples, now_ns() - atomic_load(&bc->set_time));
+        atomic_fetch_add(&bc->num_woken, 1);
+        // wait until the setter clears the event and starts the next round
+        while (atomic_load(&bc->round) == i) {
+            thrd_yield();
+        }
+    }
+    return 0;
+}
+
+static void bench_broadcast(unsigned num_waiters)
+{
+    Broadcast bc = { .go = create_event() };
+    Waiter waiters[num_waiters];
+    thrd_t threads[num_waiters];
+    if (!bc.go) {
+        perror("create_event");
+        exit(1);
+    }
+    for (unsigned i = 0; i < num_waiters; i++) {
+        waiters[i].broadcast = &bc;
+        if (!init_samples(&waiters[i].samples, num_rounds)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        thrd_create(&threads[i], waiter_thread, &waiters[i]);
+    }
+
+    struct timespec start;
+    timespec_get(&start, TIME_UTC);
+    for (unsigned i = 0; i < num_rounds; i++) {
+        atomic_store(&bc.set_time, now_ns());
+        set_event(bc.go);
+        while (atomic_load(&bc.num_woken) < num_waiters) {
+            thrd_yield();
+        }
+        clear_event(bc.go);
+        atomic_store(&bc.num_woken, 0);
+        atomic_store(&bc.round, i + 1);
+    }
+    double t = elapsed(&start);
+
+    Samples all;
+    if (!init_samples(&all, num_waiters * num_rounds)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (unsigned i = 0; i < num_waiters; i++) {
+        thrd_join(threads[i], nullptr);
+        for (unsigned j = 0; j < waiters[i].samples.count; j++) {
+            add_sample(&all, waiters[i].samples.ns[j]);
+        }
+        fini_samples(&waiters[i].samples);
+    }
+    delete_event(&bc.go);
+    printf("%7u %10.0f", num_waiters, num_rounds / t);
+    print_percentiles(&all);
+    fini_samples(&all);
+}
+
+/****************************************************************
+ * Timeout accuracy.
+ */
+
+static double timeout;
+
+typedef struct {
+    Samples samples;
+    unsigned num_waits;
+} TimeoutWaiter;
+
+static int timeout_thread(void* arg)
+{
+    TimeoutWaiter* waiter = arg;
+    Event* event = create_event();
+    if (!event) {
+        return 1;
+    }
+    uint64_t timeout_ns = timeout * 1e9;
+    for (unsigned i = 0; i < waiter->num_waits; i++) {
+        uint64_t t = now_ns();
+        wait_event(event, timeout);
+        t = now_ns() - t;
+        add_sample(&waiter->samples, (t > timeout_ns)? t - timeout_ns : 0);
+    }
+    delete_event(&event);
+    return 0;
+}
+
+static void bench_timeout(unsigned num_threads, unsigned num_waits)
+{
+    TimeoutWaiter waiters[num_threads];
+    thrd_t threads[num_threads];
+    for (unsigned i = 0; i < num_threads; i++) {
+        waiters[i].num_waits = num_waits;
+        if (!init_samples(&waiters[i].samples, num_waits)) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+        thrd_create(&threads[i], timeout_thread, &waiters[i]);
+    }
+    Samples all;
+    if (!init_samples(&all, num_threads * num_waits)) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (unsigned i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+        for (unsigned j = 0; j < waiters[i].samples.count; j++) {
+            add_sample(&all, waiters[i].samples.ns[j]);
+        }
+        fini_samples(&waiters[i].samples);
+    }
+    printf("%7u %10g", num_threads, timeout * 1e3);
+    print_percentiles(&all);
+    fini_samples(&all);
+}
+
+int main(int argc, char* argv[])
+{
+    unsigned max_threads = (argc > 1)? strtoul(argv[1], nullptr, 10) : 8;
+    num_rounds = ((argc > 2)? strtoul(argv[2], nullptr, 10) : 10) * 1'000;
+    if (max_threads == 0 || num_rounds == 0) {
+        fprintf(stderr, "usage: %s [max_threads [num_rounds_in_thousands]]\n", argv[0]);
+        return 1;
+    }
+
+    init_allocator_from_env(&pet_allocator);
+
+    printf("up to %u threads, %u rounds\n", max_threads, num_rounds);
+
+    bench_uncontended();
+
+    print_header("ping-pong, round trip us", "rounds/s");
+    for (unsigned n = 2; n <= max_threads; n *= 2) {
+        bench_ping_pong(n);
+    }
+
+    print_header("broadcast, set to wakeup us", "rounds/s");
+    for (unsigned n = 1; n <= max_threads; n *= 2) {
+        bench_broadcast(n);
+    }
+
+    print_header("timeout, overshoot us", "timeout ms");
+    for (double t = 0.0001; t < 0.02; t *= 10) {
+        timeout = t;
+        // about 0.1 s per run
+        unsigned num_waits = 0.1 / t;
+        for (unsigned n = 1; n <= max_threads; n *= 2) {
+            bench_timeout(n, num_waits);
+        }
+    }
+    return 0;
+}
@@ -31,8 +31,11 @@ typedef bool  (*FnReallocate)(void** addr_ptr, unsigned old_nbytes, unsigned new
 typedef void  (*FnRelease)   (void** addr_ptr, unsigned nbytes);
 typedef void  (*FnDump)();
 
+typedef struct _SizeProfile SizeProfile;  // see size_profile.h
+
 typedef struct {
     atomic_size_t blocks_allocated;
+    SizeProfile* size_profile;  // records requested sizes unless nullptr
 } AllocatorStats;
 
 typedef struct {
@@ -58,6 +61,80 @@ extern Allocator pet_allocator;
 extern Allocator stdlib_allocator;
 extern Allocator debug_allocator;  // checks if memory was damaged around the block
 
+typedef enum {
+    PET_FIRST_FIT,  // the first free block in the page
+    PET_BEST_FIT,   // the smallest free block in the page that fits
+    PET_NEXT_FIT    // the first free block after the previous allocation in the page
+} PetFitPolicy;
+
+typedef enum {
+    PET_REUSE_FIFO,  // pages returned to superblock go to the end of their list
+    PET_REUSE_MRU    // recently used pages are reused first
+} PetPageReuse;
+
+/*
+ * pet_allocator tunables, should be set before init_allocator(&pet_allocator).
+ * Placement policies can be changed at any time.
+ * Default values keep no cached pages, use regular pages only,
+ * and give each thread exclusive access to the page it allocates from.
+ */
+typedef struct {
+    unsigned page_cache_size;  // number of empty bitmap pages kept mapped for reuse
+    double page_decay_time;    // seconds before cached page is unmapped, zero means never
+    bool huge_pages;           // advise transparent huge pages for large blocks
+    PetFitPolicy fit_policy;
+    PetPageReuse page_reuse;
+    bool concurrent_pages;     // lock-free allocation of small blocks from shared pages, fixed at init
+    bool provision_pages;      // map pages ahead of demand in background thread, requires page cache, fixed at init
+} PetTunables;
+
+extern PetTunables pet_tunables;
+
+/*
+ * Stop page provisioner thread, if running. Pages it mapped stay in the cache.
+ * This is done at exit automatically.
+ */
+void pet_stop_provisioner();
+
+/*
+ * pet_allocator geometry for system page size,
+ * valid after init_allocator() with any allocator.
+ */
+typedef struct {
+    unsigned page_size;
+    unsigned unit_size;
+    unsigned bitmap_offset;     // size of bitmap page header without the bitmap
+    unsigned max_bitmap_block;  // bigger blocks are mapped directly and rounded up to pages
+} PetGeometry;
+
+void pet_get_geometry(PetGeometry* geometry);
+
+/*
+ * Lifetime hints for pet_allocator.
+ *
+ * Each lifetime has its own set of bitmap pages, so that long-lived blocks
+ * do not pin pages that are otherwise full of short-lived ones.
+ * The hint applies to blocks served by bitmap pages, large blocks are mapped
+ * directly anyway. Reallocated blocks keep the lifetime of the original block.
+ */
+typedef enum {
+    PET_TRANSIENT,   // the default
+    PET_PERSISTENT   // blocks that live as long as the process or a long session
+} PetLifetime;
+
+#define PET_NUM_LIFETIMES  2
+
+/*
+ * Set lifetime hint for subsequent allocations made by the current thread
+ * with pet_allocator. Return previous hint.
+ */
+PetLifetime pet_set_lifetime(PetLifetime lifetime);
+
+/*
+ * Allocate block with explicit lifetime hint regardless of the thread's one.
+ */
+void* pet_allocate_with_lifetime(unsigned nbytes, bool clean, PetLifetime lifetime);
+
 /****************************************************************
  * Alignment helpers.
  */
@@ -0,0 +1,155 @@
+#pragma once
+
+/*
+ * C++ adapters for Allocator.
+ *
+ * pussy::MemoryResource is std::pmr::memory_resource for pmr containers,
+ * pussy::StlAllocator<T> is standard allocator for regular containers.
+ * Both pass exact sizes to the sized release(), as the standard library does.
+ *
+ * Blocks are aligned at least to 16 bytes by all allocators of the library.
+ * Over-aligned requests are served from a bigger block, the address
+ * of the original block is stored right before the aligned one.
+ *
+ * Allocator takes unsigned sizes, bigger requests throw std::bad_alloc.
+ * Zero-size requests get one byte because allocators return nullptr for zero size.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+#include "allocator.h"
+
+namespace pussy {
+
+inline constexpr std::size_t natural_alignment = 16;
+
+inline void* allocate_aligned(Allocator* allocator, std::size_t nbytes, std::size_t alignment)
+{
+    if (nbytes == 0) {
+        nbytes = 1;
+    }
+    if (alignment <= natural_alignment) {
+        if (nbytes > std::numeric_limits<unsigned>::max()) {
+            throw std::bad_alloc();
+        }
+        void* block = allocator->allocate(static_cast<unsigned>(nbytes), false);
+        if (!block) {
+            throw std::bad_alloc();
+        }
+        return block;
+    }
+    if (nbytes > std::numeric_limits<unsigned>::max() - alignment) {
+        throw std::bad_alloc();
+    }
+    auto* block = static_cast<std::uint8_t*>(allocator->allocate(static_cast<unsigned>(nbytes + alignment), false));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    // there's at least natural_alignment bytes before aligned address
+    auto* result = static_cast<std::uint8_t*>(align_pointer(block + 1, static_cast<unsigned>(alignment)));
+    reinterpret_cast<void**>(result)[-1] = block;
+    return result;
+}
+
+inline void release_aligned(Allocator* allocator, void* ptr, std::size_t nbytes, std::size_t alignment) noexcept
+{
+    if (nbytes == 0) {
+        nbytes = 1;
+    }
+    if (alignment <= natural_alignment) {
+        allocator->release(&ptr, static_cast<unsigned>(nbytes));
+    } else {
+        void* block = static_cast<void**>(ptr)[-1];
+        allocator->release(&block, static_cast<unsigned>(nbytes + alignment));
+    }
+}
+
+/****************************************************************
+ * Polymorphic memory resource.
+ */
+
+class MemoryResource : public std::pmr::memory_resource {
+public:
+    explicit MemoryResource(Allocator* allocator = &default_allocator) noexcept
+        : allocator_(allocator)
+    {}
+
+    Allocator* allocator() const noexcept
+    {
+        return allocator_;
+    }
+
+protected:
+    void* do_allocate(std::size_t nbytes, std::size_t alignment) override
+    {
+        return allocate_aligned(allocator_, nbytes, alignment);
+    }
+
+    void do_deallocate(void* ptr, std::size_t nbytes, std::size_t alignment) override
+    {
+        release_aligned(allocator_, ptr, nbytes, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        auto* r = dynamic_cast<const MemoryResource*>(&other);
+        return r && r->allocator_ == allocator_;
+    }
+
+private:
+    Allocator* allocator_;
+};
+
+/****************************************************************
+ * Standard allocator.
+ */
+
+template <typename T>
+class StlAllocator {
+public:
+    using value_type = T;
+
+    StlAllocator() noexcept = default;
+
+    explicit StlAllocator(Allocator* allocator) noexcept
+        : allocator_(allocator)
+    {}
+
+    template <typename U>
+    StlAllocator(const StlAllocator<U>& other) noexcept
+        : allocator_(other.allocator())
+    {}
+
+    T* allocate(std::size_t n)
+    {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T*>(allocate_aligned(allocator_, n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* ptr, std::size_t n) noexcept
+    {
+        release_aligned(allocator_, ptr, n * sizeof(T), alignof(T));
+    }
+
+    Allocator* allocator() const noexcept
+    {
+        return allocator_;
+    }
+
+    template <typename U>
+    bool operator==(const StlAllocator<U>& other) const noexcept
+    {
+        return allocator_ == other.allocator();
+    }
+
+private:
+    Allocator* allocator_ = &default_allocator;
+};
+
+}  // namespace pussy
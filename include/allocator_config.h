@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdio.h>
+
+#include "allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Startup configuration: the default allocator and pet_allocator tunables.
+ *
+ * Environment variables:
+ *
+ *   PUSSY_ALLOCATOR               pet, stdlib, or debug
+ *   PUSSY_VERBOSE                 0 or 1
+ *   PUSSY_TRACE                   0 or 1, has effect for DEBUG builds only
+ *   PUSSY_LOG_CONFIG              0 or 1, print effective configuration to stderr, implied by verbose
+ *   PUSSY_PROFILE_SIZES           0 or 1, record requested sizes and print report to stderr at exit,
+ *                                 see size_profile.h
+ *   PUSSY_PET_PAGE_CACHE          number of empty bitmap pages kept for reuse
+ *   PUSSY_PET_DECAY_TIME          seconds before cached page is unmapped, 0 means never
+ *   PUSSY_PET_HUGE_PAGES          0 or 1, advise transparent huge pages for large blocks
+ *   PUSSY_PET_FIT                 first, best, or next: placement within bitmap page
+ *   PUSSY_PET_PAGE_REUSE          fifo or mru: order of reusing pages with free space
+ *   PUSSY_PET_CONCURRENT          0 or 1, allocate small blocks from shared pages without the lock
+ *   PUSSY_PET_PROVISION           0 or 1, map pages ahead of demand in background thread
+ *   PUSSY_PET_STATS               name of shared memory segment to publish stats, see pet_stats.h
+ *   PUSSY_PET_STATS_INTERVAL      stats update interval in seconds
+ *
+ * Typical use:
+ *
+ *   AllocatorConfig config;
+ *   default_allocator_config(&config);
+ *   config.allocator = &pet_allocator;  // program defaults
+ *   allocator_config_from_env(&config); // environment overrides them
+ *   configure_allocator(&config);
+ */
+
+typedef struct {
+    Allocator* allocator;
+    bool verbose;
+    bool trace;
+    bool log_config;
+    bool profile_sizes;
+
+    PetTunables pet;
+    char* stats_name;       // nullptr: don't publish
+    double stats_interval;
+} AllocatorConfig;
+
+void default_allocator_config(AllocatorConfig* config);
+
+/*
+ * Override config fields with environment variables.
+ * Invalid values are reported to stderr and ignored, the function returns false in this case.
+ */
+bool allocator_config_from_env(AllocatorConfig* config);
+
+/*
+ * Apply configuration and initialize default allocator.
+ * Return false if stats cannot be published, the allocator is initialized anyway.
+ */
+bool configure_allocator(AllocatorConfig* config);
+
+void print_allocator_config(FILE* fp, AllocatorConfig* config);
+
+/*
+ * Shorthand for configure_allocator with defaults overridden by the environment.
+ * `allocator` is the program default, nullptr means pet_allocator.
+ */
+bool init_allocator_from_env(Allocator* allocator);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asynchronous logger for library diagnostics.
+ *
+ * Messages are formatted by the calling thread into its own ring buffer
+ * and written to the log file descriptor, stderr by default, by a background
+ * flusher thread. Writers never take locks or make system calls:
+ * if the buffer is full the message is dropped and counted,
+ * the flusher reports the number of dropped messages.
+ *
+ * The flusher is started by the first message. Buffers are flushed at exit,
+ * if the flusher cannot be started or after it's stopped at exit,
+ * messages are written synchronously. Forked child processes write synchronously too.
+ *
+ * Messages from one thread keep their order, messages from different threads
+ * may be written out of order. Messages longer than 1 KiB are truncated.
+ */
+
+void log_printf(const char* fmt, ...);
+
+/*
+ * Log message with `prefix`, which is written verbatim.
+ */
+void log_vprintf(const char* prefix, const char* fmt, va_list ap);
+
+/*
+ * Write out all buffered messages before returning.
+ */
+void log_flush();
+
+/*
+ * Flush buffered messages, so that the last ones are not lost, and abort.
+ */
+void log_flush_and_abort();
+
+/*
+ * Set file descriptor for the log, should be called before logging anything.
+ */
+void set_log_fd(int fd);
+
+/*
+ * Return the number of messages dropped so far.
+ */
+size_t log_dropped_messages();
+
+#ifdef __cplusplus
+}
+#endif
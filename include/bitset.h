@@ -0,0 +1,264 @@
+#pragma once
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Bit range operations over arrays of words.
+ *
+ * Bit i is bit (i % WORD_WIDTH) of word (i / WORD_WIDTH),
+ * `num_bits` is the size of bitset. Bits past `num_bits` in the last word
+ * are never returned as part of a run.
+ */
+
+/****************************************************************
+ * Architecture-specific definitions.
+ */
+#if (PTRDIFF_WIDTH == 32) && (UINT_WIDTH >= 32)
+
+    typedef uint32_t Word;
+#   define WORD_WIDTH  32
+#   define WORD_MAX    0xFFFF'FFFF
+
+#elif PTRDIFF_WIDTH == 64
+
+    // on 64-bit architecture Word is configurable with WORD_WIDTH, default is 64.
+
+#   if defined(WORD_WIDTH) && (WORD_WIDTH == 32)
+
+        typedef uint32_t Word;
+#       undef  WORD_WIDTH
+#       define WORD_WIDTH  32
+#       define WORD_MAX    0xFFFF'FFFF
+
+#   else
+        typedef uint64_t Word;
+#       undef  WORD_WIDTH
+#       define WORD_WIDTH  64
+#       define WORD_MAX    0xFFFF'FFFF'FFFF'FFFF
+
+#   endif
+
+#else
+#   error Cannot define architecture-specific stuff. Please revise.
+#endif
+
+#if WORD_WIDTH == 32
+
+    static inline unsigned count_trailing_zeros(Word value)
+    {
+        //return  stdc_trailing_zeros(value);
+        return  __builtin_ctz(value);
+    }
+
+    static inline unsigned count_leading_zeros(Word value)
+    {
+        //return  stdc_leading_zeros(value);
+        return  __builtin_clz(value);
+    }
+
+    static inline unsigned count_ones(Word value)
+    {
+        //return  stdc_count_ones(value);
+        return  __builtin_popcount(value);
+    }
+
+#else
+
+    static inline unsigned count_trailing_zeros(Word value)
+    {
+        //return  stdc_trailing_zeros(value);
+        return  __builtin_ctzl(value);
+    }
+
+    static inline unsigned count_leading_zeros(Word value)
+    {
+        //return  stdc_leading_zeros(value);
+        return  __builtin_clzl(value);
+    }
+
+    static inline unsigned count_ones(Word value)
+    {
+        //return  stdc_count_ones(value);
+        return  __builtin_popcountl(value);
+    }
+
+#endif
+
+#define BITSET_NOT_FOUND  UINT_MAX
+
+static inline unsigned bitset_num_words(unsigned num_bits)
+{
+    return (num_bits + WORD_WIDTH - 1) / WORD_WIDTH;
+}
+
+/*
+ * Count consecutive zero (one) bits starting from `offset`.
+ * The `limit` is treated as a hint when to stop, returned count can be greater.
+ */
+unsigned bitset_count_zeros(Word* bitset, unsigned num_bits, unsigned offset, unsigned limit);
+unsigned bitset_count_ones(Word* bitset, unsigned num_bits, unsigned offset, unsigned limit);
+
+/*
+ * Set (clear) `length` bits starting from `offset`.
+ */
+void bitset_set_range(Word* bitset, unsigned offset, unsigned length);
+void bitset_clear_range(Word* bitset, unsigned offset, unsigned length);
+
+/*
+ * Count set bits in the range.
+ */
+unsigned bitset_popcount(Word* bitset, unsigned offset, unsigned length);
+
+/*
+ * Find the first run of at least `length` zero bits starting from `offset`.
+ * Return offset of the run or BITSET_NOT_FOUND.
+ */
+unsigned bitset_find_zeros(Word* bitset, unsigned num_bits, unsigned offset, unsigned length);
+
+/*
+ * Find the shortest run of at least `length` zero bits starting from `offset`,
+ * the first one if there are several. Return offset of the run or BITSET_NOT_FOUND.
+ */
+unsigned bitset_find_best_zeros(Word* bitset, unsigned num_bits, unsigned offset, unsigned length);
+
+/*
+ * Return the length of the longest run of zero bits starting from `offset`.
+ */
+unsigned bitset_longest_zeros(Word* bitset, unsigned num_bits, unsigned offset);
+
+/****************************************************************
+ * Word-level search for bitsets of whole words.
+ *
+ * Same as the functions above for num_bits = num_words * WORD_WIDTH.
+ * Each word is read once and runs inside it are handled with bit operations,
+ * so the outer loop has `num_words` iterations. When `num_words` is
+ * a compile-time constant the compiler unrolls it.
+ */
+
+static inline Word bitset_first_word(Word* bitset, unsigned offset)
+/*
+ * The word containing `offset` with bits below `offset` set.
+ */
+{
+    return bitset[offset / WORD_WIDTH] | ((((Word) 1) << (offset & (WORD_WIDTH - 1))) - 1);
+}
+
+static inline unsigned bitset_find_zeros_words(Word* bitset, unsigned num_words, unsigned offset, unsigned length)
+{
+    unsigned run = 0;  // zeros at the end of previous words
+    for (unsigned i = offset / WORD_WIDTH; i < num_words; i++) {
+        Word w = (i == offset / WORD_WIDTH)? bitset_first_word(bitset, offset) : bitset[i];
+        if (w == 0) {
+            run += WORD_WIDTH;
+            if (run >= length) {
+                return (i + 1) * WORD_WIDTH - run;
+            }
+            continue;
+        }
+        if (run + count_trailing_zeros(w) >= length) {
+            return i * WORD_WIDTH - run;
+        }
+        if (length < WORD_WIDTH) {
+            // bit k of runs is set if `length` bits of the word starting from k are clear
+            Word runs = ~w;
+            unsigned n = 1;
+            while (n * 2 <= length) {
+                runs &= runs >> n;
+                n *= 2;
+            }
+            runs &= runs >> (length - n);
+            if (runs) {
+                return i * WORD_WIDTH + count_trailing_zeros(runs);
+            }
+        }
+        run = count_leading_zeros(w);
+    }
+    return BITSET_NOT_FOUND;
+}
+
+static inline unsigned bitset_find_best_zeros_words(Word* bitset, unsigned num_words, unsigned offset, unsigned length)
+{
+    unsigned best = BITSET_NOT_FOUND;
+    unsigned best_length = UINT_MAX;
+    unsigned run = 0;  // zeros at the end of previous words
+    for (unsigned i = offset / WORD_WIDTH; i < num_words; i++) {
+        Word w = (i == offset / WORD_WIDTH)? bitset_first_word(bitset, offset) : bitset[i];
+        if (w == 0) {
+            run += WORD_WIDTH;
+            continue;
+        }
+        // visit runs that end in this word
+        unsigned pos = 0;
+        for (;;) {
+            unsigned zeros = count_trailing_zeros(w);
+            run += zeros;
+            pos += zeros;
+            if (run >= length && run < best_length) {
+                best = i * WORD_WIDTH + pos - run;
+                best_length = run;
+                if (run == length) {
+                    return best;
+                }
+            }
+            w >>= zeros;
+            unsigned ones = (~w)? count_trailing_zeros(~w) : WORD_WIDTH;
+            pos += ones;
+            run = 0;
+            if (pos >= WORD_WIDTH) {
+                break;
+            }
+            w >>= ones;
+            if (w == 0) {
+                run = WORD_WIDTH - pos;
+                break;
+            }
+        }
+    }
+    if (run >= length && run < best_length) {
+        best = num_words * WORD_WIDTH - run;
+    }
+    return best;
+}
+
+static inline unsigned bitset_longest_zeros_words(Word* bitset, unsigned num_words, unsigned offset)
+{
+    unsigned longest = 0;
+    unsigned run = 0;  // zeros at the end of previous words
+    for (unsigned i = offset / WORD_WIDTH; i < num_words; i++) {
+        Word w = (i == offset / WORD_WIDTH)? bitset_first_word(bitset, offset) : bitset[i];
+        if (w == 0) {
+            run += WORD_WIDTH;
+            continue;
+        }
+        unsigned trailing = count_trailing_zeros(w);
+        run += trailing;
+        if (run > longest) {
+            longest = run;
+        }
+        // zeros between the lowest and the highest set bits
+        Word inner = ~w & (WORD_MAX << trailing) & (WORD_MAX >> count_leading_zeros(w));
+        if (count_ones(inner) > longest) {
+            // the number of steps is the length of the longest run
+            unsigned n = 0;
+            while (inner) {
+                inner &= inner >> 1;
+                n++;
+            }
+            if (n > longest) {
+                longest = n;
+            }
+        }
+        run = count_leading_zeros(w);
+    }
+    return (run > longest)? run : longest;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "lock_free_stack.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Pool of fixed-size page-aligned buffers for O_DIRECT and batched I/O.
+ *
+ * Buffer size is rounded up to page size, so buffers are aligned and sized
+ * to a multiple of any block size up to the page size.
+ * Buffers are carved from large mappings made on demand, `buffers_per_chunk` at a time,
+ * and optionally locked in memory. Mappings are kept until the pool is deleted.
+ *
+ * Free buffers are kept in per-thread lists and moved to and from the shared
+ * lock-free stack in batches. Threads are assigned to lists round robin,
+ * so lists are shared when there are more threads than lists.
+ *
+ * IoBuffer is a reference-counted handle, so one buffer can be passed
+ * through several pipeline stages without copying.
+ */
+
+typedef struct _BufferPool BufferPool;
+typedef struct _IoBuffer IoBuffer;
+
+struct _IoBuffer {
+    StackNode node;      // in free lists, must be the first member
+    uint8_t* data;
+    BufferPool* pool;
+    atomic_uint refcount;
+    unsigned size;       // usable by the owner, e.g. number of bytes read
+};
+
+BufferPool* create_buffer_pool(unsigned buffer_size, unsigned buffers_per_chunk, bool lock_memory);
+
+/*
+ * Delete pool and unmap all buffers. All buffers must be returned to the pool.
+ */
+void delete_buffer_pool(BufferPool** pool_ptr);
+
+/*
+ * Return buffer with reference count 1, or nullptr on error.
+ */
+IoBuffer* get_io_buffer(BufferPool* pool);
+
+/*
+ * Return actual buffer size, rounded up to page size.
+ */
+unsigned buffer_pool_buffer_size(BufferPool* pool);
+
+static inline IoBuffer* ref_io_buffer(IoBuffer* buf)
+/*
+ * Take one more reference to the buffer.
+ */
+{
+    atomic_fetch_add_explicit(&buf->refcount, 1, memory_order_relaxed);
+    return buf;
+}
+
+/*
+ * Drop reference to the buffer and set *buf_ptr to nullptr.
+ * Buffer goes back to the pool when the last reference is dropped.
+ */
+void unref_io_buffer(IoBuffer** buf_ptr);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/types.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,9 +10,63 @@ extern "C" {
 
 void dump_bitmap(FILE* fp, uint8_t* data, unsigned size);
 
+/*
+ * Compact form of dump_bitmap: print lengths of runs of set (*) and clear (.) bits,
+ * 16 runs per line prefixed with bit offset.
+ */
+void dump_bitmap_runs(FILE* fp, uint8_t* data, unsigned size);
+
 void dump_hex(FILE* fp, unsigned indent, uint8_t* addr, unsigned size, uint8_t* display_addr, bool aligned, bool with_chars);
 void dump_hex_simple(FILE* fp, uint8_t* data, unsigned size);
 
+/*
+ * Print only rows that differ in `a` and `b`: the row from `a` prefixed with '-'
+ * and the row from `b` prefixed with '+' where equal bytes are shown as dots.
+ * Runs of same rows between different ones are printed as `-- N same rows --`.
+ *
+ * Return the number of different rows. If the output buffer for a huge indent
+ * cannot be mapped, nothing is printed and zero is returned.
+ */
+size_t dump_hex_diff(FILE* fp, unsigned indent, uint8_t* a, uint8_t* b, size_t size, uint8_t* display_addr);
+
+/*
+ * Streaming parallel dumpers.
+ *
+ * The input is split into chunks formatted by `num_threads` worker threads
+ * and written in order. Zero `num_threads` means the number of online CPUs.
+ * The output is the same as of dump_hex with aligned=false.
+ *
+ * Buffers are obtained from default allocator.
+ *
+ * dump_hex_fd maps regular files, other descriptors (pipes, devices)
+ * are read sequentially till EOF or `size` bytes and `offset` is used
+ * for display only.
+ *
+ * Return false on error, e.g. if buffers for formatted chunks, (indent + 82) * 64K bytes each,
+ * cannot be allocated.
+ */
+
+bool dump_hex_parallel(FILE* fp, unsigned indent, uint8_t* addr, size_t size, uint8_t* display_addr,
+                       bool with_chars, unsigned num_threads);
+bool dump_hex_fd(FILE* fp, int fd, off_t offset, size_t size, bool with_chars, unsigned num_threads);
+
+/*
+ * Decode `num_bytes` from 2 * `num_bytes` hex characters. Return false if invalid character is met.
+ */
+bool hex_decode(uint8_t* dest, char* src, size_t num_bytes);
+
+/*
+ * Parse dump_hex output and reconstruct bytes.
+ *
+ * Rows may be indented, the character column is ignored,
+ * `-- N same rows --` markers are expanded.
+ *
+ * Return block allocated with default allocator, its size is stored in `size`
+ * and address of the first byte shown in the dump is stored in `addr`, if not null.
+ * On error return nullptr and set errno to EINVAL or ENOMEM.
+ */
+uint8_t* parse_hex_dump(char* text, size_t length, unsigned* size, size_t* addr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,310 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "allocator.h"
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Open-addressing hash map in the style of SwissTable.
+ *
+ * The table is a single block obtained from Allocator:
+ * `capacity` slots followed by `capacity` + HASH_MAP_GROUP_WIDTH control bytes.
+ * Control byte is either 7 bits of hash of the key in the slot,
+ * or HASH_MAP_EMPTY, or HASH_MAP_DELETED. The first group of control bytes
+ * is mirrored after the end so any group can be loaded with a single
+ * unaligned load. Groups of 16 control bytes are matched with SSE2.
+ *
+ * Small tables are rehashed to a new block, big ones are grown with reallocate,
+ * that is mremap for pet_allocator, and rehashed in place, so slots are never copied
+ * to a new block.
+ *
+ * DEFINE_HASH_MAP(TypeName, prefix, key_type, value_type, hash_fn, equal_fn) defines:
+ *
+ *   void        prefix_init(TypeName* map, Allocator* allocator);  // nullptr allocator means default_allocator
+ *   void        prefix_destroy(TypeName* map);
+ *   bool        prefix_reserve(TypeName* map, unsigned num_items);
+ *   value_type* prefix_get(TypeName* map, key_type key);           // nullptr if not found
+ *   bool        prefix_put(TypeName* map, key_type key, value_type value);
+ *   bool        prefix_remove(TypeName* map, key_type key);
+ *   unsigned    prefix_size(TypeName* map);
+ *
+ * where hash_fn is uint64_t hash_fn(key_type key) and equal_fn is bool equal_fn(key_type a, key_type b).
+ */
+
+#define HASH_MAP_GROUP_WIDTH  16
+#define HASH_MAP_EMPTY        ((int8_t) -128)  // 0b1000'0000
+#define HASH_MAP_DELETED      ((int8_t) -2)    // 0b1111'1110
+
+typedef struct {
+    uint8_t* slots;      // start of the block
+    int8_t*  ctrl;
+    unsigned capacity;   // zero or power of two not less than HASH_MAP_GROUP_WIDTH
+    unsigned size;
+    unsigned growth_left;
+    unsigned nbytes;     // size of the block
+    Allocator* allocator;
+} HashMap;
+
+typedef uint64_t (*HashMapSlotHash)(void* slot);
+
+/*
+ * Make room for at least one more item: grow the table or drop deleted entries.
+ */
+bool hash_map_make_room(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash);
+
+/*
+ * Resize table to hold at least `num_items` items.
+ */
+bool hash_map_reserve(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash, unsigned num_items);
+
+void hash_map_destroy(HashMap* map);
+
+static inline uint64_t hash_u64(uint64_t x)
+/*
+ * Mixer from splitmix64.
+ */
+{
+    x ^= x >> 30;
+    x *= 0xBF58'476D'1CE4'E5B9UL;
+    x ^= x >> 27;
+    x *= 0x94D0'49BB'1331'11EBUL;
+    x ^= x >> 31;
+    return x;
+}
+
+/****************************************************************
+ * Group matching.
+ */
+
+static inline unsigned hash_map_h1(uint64_t hash)
+{
+    return (unsigned) (hash >> 7);
+}
+
+static inline int8_t hash_map_h2(uint64_t hash)
+{
+    return hash & 0x7F;
+}
+
+#ifdef __SSE2__
+
+    static inline unsigned hash_map_match(int8_t* group, int8_t value)
+    /*
+     * Return bitmask of control bytes in the group equal to `value`.
+     */
+    {
+        __m128i ctrl = _mm_loadu_si128((__m128i*) group);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value)));
+    }
+
+    static inline unsigned hash_map_match_non_full(int8_t* group)
+    /*
+     * Return bitmask of empty or deleted control bytes, they have high bit set.
+     */
+    {
+        return _mm_movemask_epi8(_mm_loadu_si128((__m128i*) group));
+    }
+
+#else
+
+    static inline unsigned hash_map_match(int8_t* group, int8_t value)
+    {
+        unsigned mask = 0;
+        for (unsigned i = 0; i < HASH_MAP_GROUP_WIDTH; i++) {
+            mask |= (unsigned) (group[i] == value) << i;
+        }
+        return mask;
+    }
+
+    static inline unsigned hash_map_match_non_full(int8_t* group)
+    {
+        unsigned mask = 0;
+        for (unsigned i = 0; i < HASH_MAP_GROUP_WIDTH; i++) {
+            mask |= (unsigned) (group[i] < 0) << i;
+        }
+        return mask;
+    }
+
+#endif
+
+static inline void hash_map_set_ctrl(HashMap* map, unsigned index, int8_t value)
+{
+    map->ctrl[index] = value;
+    if (index < HASH_MAP_GROUP_WIDTH) {
+        // mirror
+        map->ctrl[map->capacity + index] = value;
+    }
+}
+
+static inline unsigned hash_map_find_non_full(HashMap* map, uint64_t hash)
+/*
+ * Find the first empty or deleted slot in probe sequence.
+ * The table must have at least one.
+ */
+{
+    unsigned mask = map->capacity - 1;
+    unsigned pos = hash_map_h1(hash) & mask;
+    for (unsigned step = HASH_MAP_GROUP_WIDTH;; step += HASH_MAP_GROUP_WIDTH) {
+        unsigned match = hash_map_match_non_full(map->ctrl + pos);
+        if (match) {
+            return (pos + __builtin_ctz(match)) & mask;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+static inline void* hash_map_find(HashMap* map, uint64_t hash, void* key, unsigned slot_size,
+                                  bool (*match_key)(void* slot, void* key))
+/*
+ * Return slot containing `key` or nullptr.
+ * Probing stops at the first group with an empty control byte.
+ */
+{
+    if (map->size == 0) {
+        return nullptr;
+    }
+    unsigned mask = map->capacity - 1;
+    unsigned pos = hash_map_h1(hash) & mask;
+    int8_t h2 = hash_map_h2(hash);
+    for (unsigned step = HASH_MAP_GROUP_WIDTH;; step += HASH_MAP_GROUP_WIDTH) {
+        int8_t* group = map->ctrl + pos;
+        for (unsigned match = hash_map_match(group, h2); match; match &= match - 1) {
+            unsigned index = (pos + __builtin_ctz(match)) & mask;
+            void* slot = map->slots + index * slot_size;
+            if (match_key(slot, key)) {
+                return slot;
+            }
+        }
+        if (hash_map_match(group, HASH_MAP_EMPTY)) {
+            return nullptr;
+        }
+        pos = (pos + step) & mask;
+    }
+}
+
+static inline void* hash_map_insert_slot(HashMap* map, uint64_t hash, unsigned slot_size,
+                                         HashMapSlotHash slot_hash)
+/*
+ * Claim a slot for new key which must not be in the table. Return nullptr if out of memory.
+ */
+{
+    unsigned index;
+    if (map->capacity) {
+        index = hash_map_find_non_full(map, hash);
+        if (map->growth_left || map->ctrl[index] == HASH_MAP_DELETED) {
+            goto found;
+        }
+    }
+    if (!hash_map_make_room(map, slot_size, slot_hash)) {
+        return nullptr;
+    }
+    index = hash_map_find_non_full(map, hash);
+
+found:
+    if (map->ctrl[index] == HASH_MAP_EMPTY) {
+        map->growth_left--;
+    }
+    hash_map_set_ctrl(map, index, hash_map_h2(hash));
+    map->size++;
+    return map->slots + index * slot_size;
+}
+
+static inline void hash_map_erase_slot(HashMap* map, void* slot, unsigned slot_size)
+{
+    unsigned index = ((uint8_t*) slot - map->slots) / slot_size;
+    hash_map_set_ctrl(map, index, HASH_MAP_DELETED);
+    map->size--;
+}
+
+/****************************************************************
+ * Typed maps.
+ */
+
+#define DEFINE_HASH_MAP(TypeName, prefix, key_type, value_type, hash_fn, equal_fn)  \
+\
+    typedef struct {  \
+        key_type key;  \
+        value_type value;  \
+    } TypeName##Slot;  \
+\
+    typedef struct {  \
+        HashMap map;  \
+    } TypeName;  \
+\
+    static inline bool prefix##_match_key(void* slot, void* key)  \
+    {  \
+        return equal_fn(((TypeName##Slot*) slot)->key, *(key_type*) key);  \
+    }  \
+\
+    static inline uint64_t prefix##_slot_hash(void* slot)  \
+    {  \
+        return hash_fn(((TypeName##Slot*) slot)->key);  \
+    }  \
+\
+    static inline void prefix##_init(TypeName* m, Allocator* allocator)  \
+    {  \
+        memset(&m->map, 0, sizeof(HashMap));  \
+        m->map.allocator = allocator? allocator : &default_allocator;  \
+    }  \
+\
+    static inline void prefix##_destroy(TypeName* m)  \
+    {  \
+        hash_map_destroy(&m->map);  \
+    }  \
+\
+    static inline bool prefix##_reserve(TypeName* m, unsigned num_items)  \
+    {  \
+        return hash_map_reserve(&m->map, sizeof(TypeName##Slot), prefix##_slot_hash, num_items);  \
+    }  \
+\
+    static inline value_type* prefix##_get(TypeName* m, key_type key)  \
+    {  \
+        TypeName##Slot* slot = hash_map_find(&m->map, hash_fn(key), &key,  \
+                                             sizeof(TypeName##Slot), prefix##_match_key);  \
+        return slot? &slot->value : nullptr;  \
+    }  \
+\
+    static inline bool prefix##_put(TypeName* m, key_type key, value_type value)  \
+    {  \
+        uint64_t hash = hash_fn(key);  \
+        TypeName##Slot* slot = hash_map_find(&m->map, hash, &key,  \
+                                             sizeof(TypeName##Slot), prefix##_match_key);  \
+        if (!slot) {  \
+            slot = hash_map_insert_slot(&m->map, hash, sizeof(TypeName##Slot), prefix##_slot_hash);  \
+            if (!slot) {  \
+                return false;  \
+            }  \
+            slot->key = key;  \
+        }  \
+        slot->value = value;  \
+        return true;  \
+    }  \
+\
+    static inline bool prefix##_remove(TypeName* m, key_type key)  \
+    {  \
+        TypeName##Slot* slot = hash_map_find(&m->map, hash_fn(key), &key,  \
+                                             sizeof(TypeName##Slot), prefix##_match_key);  \
+        if (!slot) {  \
+            return false;  \
+        }  \
+        hash_map_erase_slot(&m->map, slot, sizeof(TypeName##Slot));  \
+        return true;  \
+    }  \
+\
+    static inline unsigned prefix##_size(TypeName* m)  \
+    {  \
+        return m->map.size;  \
+    }
+
+#ifdef __cplusplus
+}
+#endif
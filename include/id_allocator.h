@@ -0,0 +1,40 @@
+#pragma once
+
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Integer ID allocator.
+ *
+ * IDs from 0 to capacity - 1 are tracked in a bitmap with summary levels on top of it:
+ * a bit in level k+1 is set when the corresponding word in level k is full.
+ * The lowest free ID is found by descending from the top word, in O(log64 N).
+ * Memory usage is about 1 bit per ID.
+ *
+ * If batch_size is nonzero, threads take IDs in batches to per-thread caches
+ * and return them in batches as well. In this mode allocate_id returns
+ * the lowest ID from the batch, not necessarily the lowest free one.
+ * When the bitmap is exhausted, IDs cached by other threads are returned to it
+ * before giving up.
+ */
+
+#define ID_NONE  UINT_MAX
+
+typedef struct _IdAllocator IdAllocator;
+
+IdAllocator* create_id_allocator(unsigned capacity, unsigned batch_size);
+void delete_id_allocator(IdAllocator** allocator_ptr);
+
+/*
+ * Return free ID or ID_NONE if all IDs are in use.
+ */
+unsigned allocate_id(IdAllocator* allocator);
+
+void release_id(IdAllocator* allocator, unsigned id);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free LIFO of free objects (Treiber stack).
+ *
+ * Links are embedded in the objects: StackNode is placed in released block
+ * or made a member of the object. Entries of the stack are chains of nodes
+ * linked by `next` and terminated by nullptr, so a batch of objects is pushed
+ * and popped with a single compare-and-swap. A single object is a chain of one node.
+ *
+ * The top of the stack is paired with a tag incremented by every change,
+ * so a node popped and pushed back meanwhile (ABA) does not corrupt the stack.
+ * How they are paired depends on the architecture:
+ *
+ *   32-bit pointers   pointer and 32-bit tag in a 64-bit word
+ *   64-bit pointers   pointer and 64-bit tag in a 128-bit word, if 16-byte
+ *                     compare-and-swap is available (-mcx16 on x86-64, aarch64)
+ *   otherwise         48-bit pointer and 16-bit tag packed in a 64-bit word,
+ *                     ABA is possible only if a pop is preempted for a multiple
+ *                     of 65536 changes and finds the same top node
+ *
+ * Packing assumes user-space addresses fit in 48 bits and do not carry tags
+ * in the top byte.
+ *
+ * Pop reads the link of the top node, which another thread may have popped
+ * and reused concurrently. So memory of nodes must stay mapped as long
+ * as the stack is in use, i.e. released objects may be reused but not unmapped.
+ *
+ * StackCache is a batching front-end owned by one thread or guarded by a lock.
+ * It keeps up to 2 * batch_size objects and exchanges them with the shared stack
+ * batch_size at a time.
+ */
+
+typedef struct _StackNode StackNode;
+
+struct _StackNode {
+    StackNode* next;        // in chain
+    StackNode* next_chain;  // in stack, set for the first node of chain
+};
+
+#if UINTPTR_MAX == 0xFFFF'FFFF
+
+#   define _STACK_DOUBLE_WORD
+    typedef uint64_t _StackWord;
+
+#elif defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16)
+
+#   define _STACK_DOUBLE_WORD
+    __extension__ typedef unsigned __int128 _StackWord;
+
+#else
+
+#   define _STACK_PTR_BITS  48
+#   define _STACK_PTR_MASK  ((((uint64_t) 1) << _STACK_PTR_BITS) - 1)
+    typedef uint64_t _StackWord;
+
+#endif
+
+typedef union {
+    _Alignas(sizeof(_StackWord)) _StackWord value;
+#   ifdef _STACK_DOUBLE_WORD
+        struct {
+            StackNode* top;
+            uintptr_t tag;
+        };
+#   endif
+} _StackHead;
+
+typedef struct {
+    _StackHead head;
+} LockFreeStack;
+
+typedef struct {
+    StackNode* nodes;
+    unsigned count;
+} StackCache;
+
+static inline void init_lock_free_stack(LockFreeStack* stack)
+{
+    stack->head.value = 0;
+}
+
+#ifdef _STACK_DOUBLE_WORD
+
+    static inline StackNode* _stack_top(_StackHead head)
+    {
+        return head.top;
+    }
+
+    static inline _StackHead _stack_next_head(_StackHead head, StackNode* top)
+    {
+        _StackHead next = { .top = top, .tag = head.tag + 1 };
+        return next;
+    }
+
+    static inline _StackHead _stack_load(LockFreeStack* stack)
+    /*
+     * There's no atomic load of double word, so load tag before top:
+     * if they are torn by a concurrent change, the tag is outdated
+     * and the compare-and-swap fails.
+     */
+    {
+        _StackHead head;
+        head.tag = __atomic_load_n(&stack->head.tag, __ATOMIC_ACQUIRE);
+        head.top = __atomic_load_n(&stack->head.top, __ATOMIC_ACQUIRE);
+        return head;
+    }
+
+#else
+
+    static inline StackNode* _stack_top(_StackHead head)
+    {
+        return (StackNode*) (uintptr_t) (head.value & _STACK_PTR_MASK);
+    }
+
+    static inline _StackHead _stack_next_head(_StackHead head, StackNode* top)
+    {
+        uint64_t tag = (head.value >> _STACK_PTR_BITS) + 1;
+        _StackHead next = { .value = (tag << _STACK_PTR_BITS) | (uint64_t) (uintptr_t) top };
+        return next;
+    }
+
+    static inline _StackHead _stack_load(LockFreeStack* stack)
+    {
+        _StackHead head = { .value = __atomic_load_n(&stack->head.value, __ATOMIC_ACQUIRE) };
+        return head;
+    }
+
+#endif
+
+static inline bool _stack_cas(LockFreeStack* stack, _StackHead* expected, _StackHead desired)
+/*
+ * Full barrier. On failure update `expected` with the current head.
+ */
+{
+    _StackWord prev = __sync_val_compare_and_swap(&stack->head.value, expected->value, desired.value);
+    if (prev == expected->value) {
+        return true;
+    }
+    expected->value = prev;
+    return false;
+}
+
+static inline void stack_push(LockFreeStack* stack, StackNode* chain)
+/*
+ * Push chain of nodes terminated by nullptr.
+ */
+{
+    _StackHead head = _stack_load(stack);
+    do {
+        __atomic_store_n(&chain->next_chain, _stack_top(head), __ATOMIC_RELAXED);
+    } while (!_stack_cas(stack, &head, _stack_next_head(head, chain)));
+}
+
+static inline StackNode* stack_pop(LockFreeStack* stack)
+/*
+ * Pop chain of nodes, return nullptr if the stack is empty.
+ */
+{
+    _StackHead head = _stack_load(stack);
+    for (StackNode* top; (top = _stack_top(head));) {
+        StackNode* next = __atomic_load_n(&top->next_chain, __ATOMIC_RELAXED);
+        if (_stack_cas(stack, &head, _stack_next_head(head, next))) {
+            return top;
+        }
+    }
+    return nullptr;
+}
+
+static inline bool stack_is_empty(LockFreeStack* stack)
+{
+    return _stack_top(_stack_load(stack)) == nullptr;
+}
+
+/****************************************************************
+ * Batching front-end.
+ */
+
+static inline StackNode* cache_pop(StackCache* cache, LockFreeStack* stack)
+/*
+ * Take node from the cache, refill it from the stack if empty.
+ * Return nullptr if both are empty.
+ */
+{
+    if (!cache->nodes) {
+        cache->nodes = stack_pop(stack);
+        cache->count = 0;
+        for (StackNode* node = cache->nodes; node; node = node->next) {
+            cache->count++;
+        }
+        if (!cache->nodes) {
+            return nullptr;
+        }
+    }
+    StackNode* node = cache->nodes;
+    cache->nodes = node->next;
+    cache->count--;
+    return node;
+}
+
+static inline void cache_push(StackCache* cache, LockFreeStack* stack, StackNode* node, unsigned batch_size)
+/*
+ * Put node to the cache. When the cache holds 2 * batch_size nodes,
+ * keep the most recently pushed ones, they are likely in CPU cache,
+ * and push the rest to the stack.
+ */
+{
+    node->next = cache->nodes;
+    cache->nodes = node;
+    if (++cache->count < 2 * batch_size) {
+        return;
+    }
+    StackNode* tail = cache->nodes;
+    for (unsigned i = 1; i < batch_size; i++) {
+        tail = tail->next;
+    }
+    StackNode* batch = tail->next;
+    tail->next = nullptr;
+    cache->count = batch_size;
+    stack_push(stack, batch);
+}
+
+static inline void flush_stack_cache(StackCache* cache, LockFreeStack* stack)
+/*
+ * Push all cached nodes to the stack.
+ */
+{
+    if (cache->nodes) {
+        stack_push(stack, cache->nodes);
+        cache->nodes = nullptr;
+        cache->count = 0;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Binary snapshot of pet_allocator heap.
+ *
+ * The file contains PetSnapshotHeader followed by `num_pages` records,
+ * each record is PetSnapshotPage followed by the raw page bitmap
+ * of `bitmap_size` bytes. Records are ordered by lifetime and superblock entry, i.e. by LFB.
+ *
+ * All fields are in native byte order, the analyzer must run on the same architecture.
+ *
+ * Pages taken out of the superblock by other threads at the moment
+ * of snapshot are not included. Hot pages of concurrent mode are included.
+ *
+ * pet_allocator does not keep track of individual blocks allocated directly
+ * with mmap, only their number and total size are saved.
+ */
+
+#define PET_SNAPSHOT_MAGIC    "PETSNAP"
+#define PET_SNAPSHOT_VERSION  2
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t unit_size;
+    uint32_t units_per_page;
+    uint32_t header_units;   // units reserved for page header, they are marked as used in the bitmap
+    uint32_t bitmap_size;    // in bytes
+    uint64_t num_pages;      // number of page records
+    uint64_t num_bm_pages;   // total number of bm pages, can be greater than num_pages
+    uint64_t blocks_allocated;
+    uint64_t num_large_blocks;
+    uint64_t large_mapped_bytes;
+} PetSnapshotHeader;
+
+typedef struct {
+    uint64_t addr;
+    uint32_t lfb;       // longest free block, in units
+    uint32_t lifetime;  // PetLifetime of the page
+} PetSnapshotPage;
+
+/*
+ * Write snapshot to file descriptor. Return false on error.
+ */
+bool pet_snapshot(int fd);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+
+#include "allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Live pet_allocator stats published in a named POSIX shared memory segment.
+ *
+ * The segment is updated by a publisher thread with seqlock semantics:
+ * the sequence number is odd while the update is in progress.
+ * Readers never block the process, they retry if the sequence changed
+ * and give up if the update does not complete after PET_STATS_READ_ATTEMPTS,
+ * e.g. because the process died in the middle of it.
+ */
+
+#define PET_STATS_READ_ATTEMPTS  100
+
+typedef struct {
+    atomic_uint seq;
+    uint32_t page_size;
+    uint32_t unit_size;
+    uint32_t num_lfb_buckets;     // units_per_page
+    uint64_t update_count;
+    uint64_t blocks_allocated;
+    uint64_t num_bm_pages;
+    uint64_t num_large_blocks;
+    uint64_t mapped_bytes;        // bm pages and large blocks
+    uint64_t lock_acquisitions;
+    uint64_t lock_contentions;    // how many times the lock was busy
+    uint64_t lifetime_pages[PET_NUM_LIFETIMES];  // bm pages of each lifetime, indexed by PetLifetime
+    uint64_t lifetime_units[PET_NUM_LIFETIMES];  // units allocated in them
+    uint32_t lfb_population[];    // number of pages in each superblock entry, all lifetimes
+} PetSharedStats;
+
+/*
+ * Create shared memory segment `name` (see shm_open) and start publisher thread
+ * that updates it every `interval` seconds.
+ */
+bool pet_publish_stats(char* name, double interval);
+
+/*
+ * Stop publisher thread and unlink the segment.
+ */
+void pet_unpublish_stats();
+
+/*
+ * Read consistent copy of stats. The `copy` must be at least as large as the segment.
+ * Return false if no consistent copy could be taken, the segment is stale in this case.
+ */
+static inline bool pet_read_shared_stats(PetSharedStats* shared, PetSharedStats* copy, size_t size)
+{
+    for (unsigned i = 0; i < PET_STATS_READ_ATTEMPTS; i++) {
+        if (i) {
+            // let the publisher complete the update
+            thrd_yield();
+        }
+        unsigned seq = atomic_load_explicit(&shared->seq, memory_order_acquire);
+        if (seq & 1) {
+            continue;
+        }
+        memcpy(((uint8_t*) copy) + sizeof(atomic_uint), ((uint8_t*) shared) + sizeof(atomic_uint),
+               size - sizeof(atomic_uint));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shared->seq, memory_order_relaxed) == seq) {
+            copy->seq = seq;
+            return true;
+        }
+    }
+    return false;
+}
+
+#ifdef __cplusplus
+}
+#endif
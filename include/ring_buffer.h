@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Ring buffer with data pages mapped twice, back to back.
+ *
+ * Any region up to capacity bytes starting anywhere in the buffer
+ * is contiguous in memory, so records never wrap and can be written
+ * and read in place, and a single read/write syscall transfers all
+ * available data.
+ *
+ * Positions are free-running counters, offset in the buffer is position modulo capacity.
+ * One producer and one consumer can work concurrently without locks.
+ */
+
+typedef struct {
+    uint8_t* data;       // 2 * capacity bytes of address space
+    size_t capacity;     // multiple of page size
+    atomic_size_t read_pos;
+    atomic_size_t write_pos;
+} RingBuffer;
+
+/*
+ * Create ring buffer, capacity is rounded up to page size.
+ * Return nullptr and set errno on error.
+ */
+RingBuffer* create_ring_buffer(size_t capacity);
+
+void delete_ring_buffer(RingBuffer** rb_ptr);
+
+/****************************************************************
+ * Cursors.
+ */
+
+static inline size_t ring_buffer_readable(RingBuffer* rb)
+{
+    return atomic_load_explicit(&rb->write_pos, memory_order_acquire)
+         - atomic_load_explicit(&rb->read_pos, memory_order_relaxed);
+}
+
+static inline size_t ring_buffer_writable(RingBuffer* rb)
+{
+    return rb->capacity
+         - (atomic_load_explicit(&rb->write_pos, memory_order_relaxed)
+            - atomic_load_explicit(&rb->read_pos, memory_order_acquire));
+}
+
+static inline uint8_t* ring_buffer_read_ptr(RingBuffer* rb, size_t* available)
+/*
+ * Return pointer to pending data and its size, for consumer.
+ */
+{
+    *available = ring_buffer_readable(rb);
+    return rb->data + atomic_load_explicit(&rb->read_pos, memory_order_relaxed) % rb->capacity;
+}
+
+static inline void ring_buffer_consume(RingBuffer* rb, size_t n)
+/*
+ * Advance read cursor after consumer is done with `n` bytes.
+ */
+{
+    atomic_fetch_add_explicit(&rb->read_pos, n, memory_order_release);
+}
+
+static inline uint8_t* ring_buffer_write_ptr(RingBuffer* rb, size_t* available)
+/*
+ * Return pointer to free space and its size, for producer.
+ */
+{
+    *available = ring_buffer_writable(rb);
+    return rb->data + atomic_load_explicit(&rb->write_pos, memory_order_relaxed) % rb->capacity;
+}
+
+static inline void ring_buffer_commit(RingBuffer* rb, size_t n)
+/*
+ * Advance write cursor to publish `n` bytes written by producer.
+ */
+{
+    atomic_fetch_add_explicit(&rb->write_pos, n, memory_order_release);
+}
+
+/****************************************************************
+ * Copying helpers.
+ */
+
+/*
+ * Append `size` bytes, all or nothing.
+ */
+bool ring_buffer_write(RingBuffer* rb, void* data, size_t size);
+
+/*
+ * Read up to `size` bytes, return number of bytes read.
+ */
+size_t ring_buffer_read(RingBuffer* rb, void* dest, size_t size);
+
+/****************************************************************
+ * Zero-copy I/O.
+ *
+ * iovec functions describe pending data or free space with single iovec
+ * so it can be combined with other buffers in readv/writev/sendmsg/recvmsg.
+ * The caller advances the cursor by the number of bytes actually transferred.
+ */
+
+size_t ring_buffer_read_iov(RingBuffer* rb, struct iovec* iov);
+size_t ring_buffer_write_iov(RingBuffer* rb, struct iovec* iov);
+
+/*
+ * Receive as much data from `fd` as fits in free space, with single readv.
+ * Return the result of readv, cursor is advanced accordingly.
+ * If the buffer is full, return -1 and set errno to ENOBUFS.
+ */
+ssize_t ring_buffer_readv(RingBuffer* rb, int fd);
+
+/*
+ * Send pending data to `fd` with single writev.
+ * Return the result of writev, cursor is advanced accordingly.
+ */
+ssize_t ring_buffer_writev(RingBuffer* rb, int fd);
+
+#ifdef __cplusplus
+}
+#endif
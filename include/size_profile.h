@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocation size profiler.
+ *
+ * Records requested sizes in a log-bucketed histogram: sizes below 16 bytes
+ * have their own buckets, bigger ones are split into 8 buckets per power of two.
+ * Each thread counts in its own block of counters, so recording is
+ * a couple of non-atomic increments. Readers sum the blocks of all threads,
+ * including exited ones.
+ *
+ * Profiling is enabled per allocator. Allocators record sizes passed to allocate()
+ * and new sizes passed to reallocate().
+ */
+
+#define SIZE_PROFILE_NUM_BUCKETS  240
+
+typedef struct {
+    uint64_t count[SIZE_PROFILE_NUM_BUCKETS];
+    uint64_t bytes[SIZE_PROFILE_NUM_BUCKETS];
+} SizeHistogram;
+
+static inline unsigned size_bucket(unsigned nbytes)
+{
+    if (nbytes < 8) {
+        return nbytes;
+    }
+    unsigned order = 31 - __builtin_clz(nbytes);  // 3..31
+    return 8 + (order - 3) * 8 + ((nbytes >> (order - 3)) & 7);
+}
+
+static inline uint64_t size_bucket_lower(unsigned bucket)
+/*
+ * The smallest size in the bucket.
+ */
+{
+    if (bucket < 8) {
+        return bucket;
+    }
+    unsigned order = 3 + (bucket - 8) / 8;
+    return ((uint64_t) (8 + (bucket & 7))) << (order - 3);
+}
+
+static inline uint64_t size_bucket_upper(unsigned bucket)
+/*
+ * The size next to the biggest one in the bucket.
+ */
+{
+    return size_bucket_lower(bucket + 1);
+}
+
+/*
+ * Create profile and attach it to the allocator.
+ * This should be done before the allocator is used by more than one thread.
+ * Return false if the profile cannot be created, errno is set in this case.
+ */
+bool enable_size_profile(Allocator* allocator);
+
+/*
+ * Detach profile from the allocator and delete it.
+ * The allocator must not be in use by other threads.
+ */
+void disable_size_profile(Allocator* allocator);
+
+/*
+ * Record requested size, called by allocators.
+ */
+void size_profile_record(SizeProfile* profile, unsigned nbytes);
+
+/*
+ * Sum counters of all threads. Return false if profiling is not enabled for the allocator.
+ */
+bool read_size_profile(Allocator* allocator, SizeHistogram* histogram);
+
+/*
+ * Print histogram, waste estimate for pet_allocator geometry,
+ * and suggested unit size and size classes for the workload.
+ *
+ * Waste is estimated assuming sizes are evenly spread within each bucket.
+ * Size classes are picked from bucket bounds to minimize rounding waste.
+ */
+void print_size_report(FILE* fp, SizeHistogram* histogram, PetGeometry* geometry);
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,11 +13,28 @@ typedef struct {
     atomic_bool flag;
 } Event;
 
+/*
+ * Deleted events are kept in a pool for reuse by create_event,
+ * their memory is not returned to the allocator.
+ */
 Event* create_event();
 void delete_event(Event** event_ptr);
+
+/*
+ * Initialize and finalize event embedded in another structure or static.
+ * init_event returns false on error, errno is set in this case.
+ */
+bool init_event(Event* event);
+void fini_event(Event* event);
+
 void set_event(Event* event);
 void clear_event(Event* event);
 bool event_is_set(Event* event);
+
+/*
+ * Wait until the event is set or `timeout` seconds pass, negative timeout means no limit.
+ * Return true if the event is set.
+ */
 bool wait_event(Event* event, double timeout);
 
 #ifdef __cplusplus
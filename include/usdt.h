@@ -0,0 +1,127 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * USDT (user-level statically defined tracing) probes in the format of systemtap sdt.h.
+ *
+ * A probe site is a nop described by an entry in .note.stapsdt ELF section,
+ * so perf, bpftrace and other tools attach to it without recompiling:
+ *
+ *   perf buildid-cache --add ./program && perf probe sdt_pussy:pet_mmap
+ *   bpftrace -e 'usdt:./program:pussy:pet_mmap { printf("%p %d\n", arg0, arg1); }'
+ *   readelf -n ./program  # list probes
+ *
+ * Each probe has a semaphore in .probes section, incremented by the tracer
+ * when it attaches. Probe arguments are evaluated and the nop is reached
+ * only when the semaphore is nonzero, so a disabled probe costs a load
+ * and a predicted branch.
+ *
+ * Arguments are passed as signed 64-bit integers, up to 4 per probe.
+ *
+ * Usage:
+ *
+ *   USDT_SEMAPHORE(provider, name);  // at file scope, once per probe
+ *
+ *   USDT_PROBE2(provider, name, arg1, arg2);
+ *
+ * Probes compile to nothing on architectures other than x86-64 and aarch64,
+ * and with PUSSY_NO_USDT defined.
+ */
+
+#if (defined(__x86_64__) || defined(__aarch64__)) && defined(__ELF__) && !defined(PUSSY_NO_USDT)
+
+#define USDT_SEMAPHORE(provider, name) \
+    __attribute__((used, section(".probes"), visibility("hidden"))) \
+    volatile unsigned short provider##_##name##_semaphore
+
+#define USDT_ENABLED(provider, name)  __builtin_expect(provider##_##name##_semaphore, 0)
+
+/*
+ * Note layout: nop address, link-time address of _.stapsdt.base
+ * for prelink adjustment, semaphore address, provider, name, arguments.
+ */
+#define _USDT_NOTE(provider, name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte " #provider "_" #name "_semaphore\n" \
+    ".asciz \"" #provider "\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define _USDT_ARG(n, value)  [_a##n] "nor" ((int64_t) (value))
+
+#define USDT_PROBE0(provider, name) \
+    do { \
+        if (USDT_ENABLED(provider, name)) { \
+            __asm__ __volatile__ (_USDT_NOTE(provider, name, "")); \
+        } \
+    } while (0)
+
+#define USDT_PROBE1(provider, name, a1) \
+    do { \
+        if (USDT_ENABLED(provider, name)) { \
+            __asm__ __volatile__ (_USDT_NOTE(provider, name, "-8@%[_a1]") \
+                                  :: _USDT_ARG(1, a1)); \
+        } \
+    } while (0)
+
+#define USDT_PROBE2(provider, name, a1, a2) \
+    do { \
+        if (USDT_ENABLED(provider, name)) { \
+            __asm__ __volatile__ (_USDT_NOTE(provider, name, "-8@%[_a1] -8@%[_a2]") \
+                                  :: _USDT_ARG(1, a1), _USDT_ARG(2, a2)); \
+        } \
+    } while (0)
+
+#define USDT_PROBE3(provider, name, a1, a2, a3) \
+    do { \
+        if (USDT_ENABLED(provider, name)) { \
+            __asm__ __volatile__ (_USDT_NOTE(provider, name, "-8@%[_a1] -8@%[_a2] -8@%[_a3]") \
+                                  :: _USDT_ARG(1, a1), _USDT_ARG(2, a2), _USDT_ARG(3, a3)); \
+        } \
+    } while (0)
+
+#define USDT_PROBE4(provider, name, a1, a2, a3, a4) \
+    do { \
+        if (USDT_ENABLED(provider, name)) { \
+            __asm__ __volatile__ (_USDT_NOTE(provider, name, "-8@%[_a1] -8@%[_a2] -8@%[_a3] -8@%[_a4]") \
+                                  :: _USDT_ARG(1, a1), _USDT_ARG(2, a2), _USDT_ARG(3, a3), _USDT_ARG(4, a4)); \
+        } \
+    } while (0)
+
+#else
+
+#define USDT_SEMAPHORE(provider, name)  static_assert(true, "")
+#define USDT_ENABLED(provider, name)    false
+
+// arguments are not evaluated, sizeof keeps variables used only by probes from being unused
+
+#define USDT_PROBE0(provider, name) \
+    do {} while (0)
+#define USDT_PROBE1(provider, name, a1) \
+    do { (void) sizeof(a1); } while (0)
+#define USDT_PROBE2(provider, name, a1, a2) \
+    do { (void) sizeof(a1); (void) sizeof(a2); } while (0)
+#define USDT_PROBE3(provider, name, a1, a2, a3) \
+    do { (void) sizeof(a1); (void) sizeof(a2); (void) sizeof(a3); } while (0)
+#define USDT_PROBE4(provider, name, a1, a2, a3, a4) \
+    do { (void) sizeof(a1); (void) sizeof(a2); (void) sizeof(a3); (void) sizeof(a4); } while (0)
+
+#endif
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <limits.h>
+#include <string.h>
+
+#include "allocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Growable vectors over the sized Allocator API.
+ *
+ * DEFINE_VECTOR(TypeName, prefix, item_type) defines vector type and functions:
+ *
+ *   void prefix_init(TypeName* v, Allocator* allocator);  // nullptr allocator means default_allocator
+ *   void prefix_destroy(TypeName* v);
+ *   bool prefix_reserve(TypeName* v, unsigned capacity);
+ *   bool prefix_append(TypeName* v, item_type item);
+ *   bool prefix_append_many(TypeName* v, item_type* items, unsigned count);
+ *   void prefix_clear(TypeName* v);
+ *
+ * Small vectors grow geometrically inside bitmap pages where reallocate
+ * often extends the block in place. Vectors of page size and more grow by
+ * whole pages: pet_allocator extends them with mremap, so data is never copied.
+ *
+ * Vectors for basic types are predefined and vector_* macros dispatch to them with _Generic.
+ */
+
+static inline unsigned vector_grow_nbytes(unsigned nbytes, unsigned min_nbytes)
+/*
+ * Calculate new size in bytes for vector growth.
+ */
+{
+    unsigned new_nbytes;
+    if (nbytes < sys_page_size) {
+        new_nbytes = nbytes? nbytes * 2 : 64;
+    } else {
+        new_nbytes = nbytes + nbytes / 2;
+    }
+    if (new_nbytes < min_nbytes || new_nbytes < nbytes) {
+        new_nbytes = min_nbytes;
+    }
+    if (new_nbytes >= sys_page_size) {
+        // use the whole last page
+        unsigned aligned = align_unsigned_to_page(new_nbytes);
+        if (aligned > new_nbytes) {
+            new_nbytes = aligned;
+        }
+    }
+    return new_nbytes;
+}
+
+#define DEFINE_VECTOR(TypeName, prefix, item_type)  \
+\
+    typedef struct {  \
+        item_type* data;  \
+        unsigned length;  \
+        unsigned capacity;  \
+        Allocator* allocator;  \
+    } TypeName;  \
+\
+    static inline void prefix##_init(TypeName* v, Allocator* allocator)  \
+    {  \
+        v->data = nullptr;  \
+        v->length = 0;  \
+        v->capacity = 0;  \
+        v->allocator = allocator? allocator : &default_allocator;  \
+    }  \
+\
+    static inline void prefix##_destroy(TypeName* v)  \
+    {  \
+        if (v->data) {  \
+            v->allocator->release((void**) &v->data, v->capacity * sizeof(item_type));  \
+        }  \
+        v->length = 0;  \
+        v->capacity = 0;  \
+    }  \
+\
+    static inline bool prefix##_realloc(TypeName* v, unsigned nbytes)  \
+    {  \
+        if (!v->allocator->reallocate((void**) &v->data, v->capacity * sizeof(item_type),  \
+                                      nbytes, false, nullptr)) {  \
+            return false;  \
+        }  \
+        v->capacity = nbytes / sizeof(item_type);  \
+        return true;  \
+    }  \
+\
+    static inline bool prefix##_reserve(TypeName* v, unsigned capacity)  \
+    {  \
+        if (capacity <= v->capacity) {  \
+            return true;  \
+        }  \
+        if ((uint64_t) capacity * sizeof(item_type) > UINT_MAX) {  \
+            return false;  \
+        }  \
+        return prefix##_realloc(v, capacity * sizeof(item_type));  \
+    }  \
+\
+    static inline bool prefix##_grow(TypeName* v, unsigned count)  \
+    {  \
+        if (count > UINT_MAX / sizeof(item_type) - v->length) {  \
+            return false;  \
+        }  \
+        unsigned nbytes = vector_grow_nbytes(v->capacity * sizeof(item_type),  \
+                                             (v->length + count) * sizeof(item_type));  \
+        return prefix##_realloc(v, nbytes - nbytes % sizeof(item_type));  \
+    }  \
+\
+    static inline bool prefix##_append(TypeName* v, item_type item)  \
+    {  \
+        if (v->length == v->capacity && !prefix##_grow(v, 1)) {  \
+            return false;  \
+        }  \
+        v->data[v->length++] = item;  \
+        return true;  \
+    }  \
+\
+    static inline bool prefix##_append_many(TypeName* v, item_type* items, unsigned count)  \
+    {  \
+        if (count > v->capacity - v->length && !prefix##_grow(v, count)) {  \
+            return false;  \
+        }  \
+        memcpy(v->data + v->length, items, count * sizeof(item_type));  \
+        v->length += count;  \
+        return true;  \
+    }  \
+\
+    static inline void prefix##_clear(TypeName* v)  \
+    {  \
+        v->length = 0;  \
+    }
+
+DEFINE_VECTOR(VectorU8,  vector_u8,  uint8_t)
+DEFINE_VECTOR(VectorU32, vector_u32, uint32_t)
+DEFINE_VECTOR(VectorU64, vector_u64, uint64_t)
+DEFINE_VECTOR(VectorPtr, vector_ptr, void*)
+
+#define _VECTOR_DISPATCH(v, fn)  _Generic((v),  \
+        VectorU8*:  vector_u8_##fn,  \
+        VectorU32*: vector_u32_##fn,  \
+        VectorU64*: vector_u64_##fn,  \
+        VectorPtr*: vector_ptr_##fn  \
+    )
+
+#define vector_init(v, allocator)               _VECTOR_DISPATCH((v), init)((v), (allocator))
+#define vector_destroy(v)                       _VECTOR_DISPATCH((v), destroy)((v))
+#define vector_reserve(v, capacity)             _VECTOR_DISPATCH((v), reserve)((v), (capacity))
+#define vector_append(v, item)                  _VECTOR_DISPATCH((v), append)((v), (item))
+#define vector_append_many(v, items, count)     _VECTOR_DISPATCH((v), append_many)((v), (items), (count))
+#define vector_clear(v)                         _VECTOR_DISPATCH((v), clear)((v))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,241 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator_config.h"
+#include "pet_stats.h"
+#include "size_profile.h"
+
+typedef struct {
+    char* name;
+    Allocator* allocator;
+} AllocatorName;
+
+static AllocatorName allocator_names[] = {
+    { "pet",    &pet_allocator },
+    { "stdlib", &stdlib_allocator },
+    { "debug",  &debug_allocator }
+};
+
+#define NUM_NAMES(array)  (sizeof(array) / sizeof(array[0]))
+#define NUM_ALLOCATORS    NUM_NAMES(allocator_names)
+
+// indexed by PetFitPolicy and PetPageReuse
+static char* fit_policy_names[] = { "first", "best", "next" };
+static char* page_reuse_names[] = { "fifo", "mru" };
+
+static char* allocator_name(Allocator* allocator)
+{
+    for (unsigned i = 0; i < NUM_ALLOCATORS; i++) {
+        if (allocator_names[i].allocator == allocator) {
+            return allocator_names[i].name;
+        }
+    }
+    return "custom";
+}
+
+static void bad_value(char* var, char* value)
+{
+    fprintf(stderr, "libpussy: bad value of %s: %s\n", var, value);
+}
+
+/****************************************************************
+ * Environment parsers. Return false if the value is set and invalid.
+ */
+
+static bool env_bool(char* var, bool* result)
+{
+    char* value = getenv(var);
+    if (!value) {
+        return true;
+    }
+    if (strcmp(value, "1") == 0) {
+        *result = true;
+    } else if (strcmp(value, "0") == 0) {
+        *result = false;
+    } else {
+        bad_value(var, value);
+        return false;
+    }
+    return true;
+}
+
+static bool env_unsigned(char* var, unsigned* result)
+{
+    char* value = getenv(var);
+    if (!value) {
+        return true;
+    }
+    char* end;
+    errno = 0;
+    unsigned long n = strtoul(value, &end, 10);
+    if (end == value || *end || errno || n > UINT_MAX || *value == '-') {
+        bad_value(var, value);
+        return false;
+    }
+    *result = n;
+    return true;
+}
+
+static bool env_seconds(char* var, double* result)
+{
+    char* value = getenv(var);
+    if (!value) {
+        return true;
+    }
+    char* end;
+    double n = strtod(value, &end);
+    if (end == value || *end || !(n >= 0)) {
+        bad_value(var, value);
+        return false;
+    }
+    *result = n;
+    return true;
+}
+
+static bool env_choice(char* var, char** names, unsigned num_names, unsigned* result)
+{
+    char* value = getenv(var);
+    if (!value) {
+        return true;
+    }
+    for (unsigned i = 0; i < num_names; i++) {
+        if (strcmp(value, names[i]) == 0) {
+            *result = i;
+            return true;
+        }
+    }
+    bad_value(var, value);
+    return false;
+}
+
+static bool env_allocator(char* var, Allocator** result)
+{
+    char* value = getenv(var);
+    if (!value) {
+        return true;
+    }
+    for (unsigned i = 0; i < NUM_ALLOCATORS; i++) {
+        if (strcmp(value, allocator_names[i].name) == 0) {
+            *result = allocator_names[i].allocator;
+            return true;
+        }
+    }
+    bad_value(var, value);
+    return false;
+}
+
+/****************************************************************
+ * Size report at exit
+ */
+
+static Allocator* profiled_allocator = nullptr;
+
+static void print_size_report_at_exit()
+{
+    SizeHistogram histogram;
+    if (read_size_profile(profiled_allocator, &histogram)) {
+        PetGeometry geometry;
+        pet_get_geometry(&geometry);
+        fprintf(stderr, "libpussy: size profile of %s allocator\n", allocator_name(profiled_allocator));
+        print_size_report(stderr, &histogram, &geometry);
+    }
+}
+
+/****************************************************************
+ * Public functions
+ */
+
+void default_allocator_config(AllocatorConfig* config)
+{
+    memset(config, 0, sizeof(AllocatorConfig));
+    config->allocator = &pet_allocator;
+    config->stats_interval = 1;
+}
+
+bool allocator_config_from_env(AllocatorConfig* config)
+{
+    bool ok = true;
+    ok &= env_allocator("PUSSY_ALLOCATOR",            &config->allocator);
+    ok &= env_bool     ("PUSSY_VERBOSE",              &config->verbose);
+    ok &= env_bool     ("PUSSY_TRACE",                &config->trace);
+    ok &= env_bool     ("PUSSY_LOG_CONFIG",           &config->log_config);
+    ok &= env_bool     ("PUSSY_PROFILE_SIZES",        &config->profile_sizes);
+    ok &= env_unsigned ("PUSSY_PET_PAGE_CACHE",       &config->pet.page_cache_size);
+    ok &= env_seconds  ("PUSSY_PET_DECAY_TIME",       &config->pet.page_decay_time);
+    ok &= env_bool     ("PUSSY_PET_HUGE_PAGES",       &config->pet.huge_pages);
+    ok &= env_bool     ("PUSSY_PET_CONCURRENT",       &config->pet.concurrent_pages);
+    ok &= env_bool     ("PUSSY_PET_PROVISION",        &config->pet.provision_pages);
+    ok &= env_seconds  ("PUSSY_PET_STATS_INTERVAL",   &config->stats_interval);
+
+    unsigned choice = config->pet.fit_policy;
+    ok &= env_choice("PUSSY_PET_FIT", fit_policy_names, NUM_NAMES(fit_policy_names), &choice);
+    config->pet.fit_policy = choice;
+    choice = config->pet.page_reuse;
+    ok &= env_choice("PUSSY_PET_PAGE_REUSE", page_reuse_names, NUM_NAMES(page_reuse_names), &choice);
+    config->pet.page_reuse = choice;
+
+    char* stats_name = getenv("PUSSY_PET_STATS");
+    if (stats_name) {
+        config->stats_name = *stats_name? stats_name : nullptr;
+    }
+    if (config->stats_interval == 0) {
+        bad_value("PUSSY_PET_STATS_INTERVAL", "0");
+        config->stats_interval = 1;
+        ok = false;
+    }
+    return ok;
+}
+
+bool configure_allocator(AllocatorConfig* config)
+{
+    Allocator* allocator = config->allocator? config->allocator : &pet_allocator;
+    allocator->verbose = config->verbose;
+    allocator->trace = config->trace;
+    if (allocator == &pet_allocator) {
+        pet_tunables = config->pet;
+    }
+    init_allocator(allocator);
+
+    if (config->log_config || config->verbose) {
+        print_allocator_config(stderr, config);
+    }
+    if (config->profile_sizes && !profiled_allocator) {
+        if (enable_size_profile(allocator)) {
+            profiled_allocator = allocator;
+            atexit(print_size_report_at_exit);
+        } else {
+            fprintf(stderr, "libpussy: cannot enable size profile: %s\n", strerror(errno));
+        }
+    }
+    if (config->stats_name && allocator == &pet_allocator) {
+        return pet_publish_stats(config->stats_name, config->stats_interval);
+    }
+    return true;
+}
+
+void print_allocator_config(FILE* fp, AllocatorConfig* config)
+{
+    Allocator* allocator = config->allocator? config->allocator : &pet_allocator;
+    fprintf(fp, "libpussy: allocator=%s verbose=%d trace=%d profile_sizes=%d\n",
+            allocator_name(allocator), config->verbose, config->trace, config->profile_sizes);
+    if (allocator == &pet_allocator) {
+        fprintf(fp, "libpussy: pet fit=%s page_reuse=%s page_cache=%u decay_time=%g huge_pages=%d"
+                " concurrent=%d provision=%d stats=%s stats_interval=%g\n",
+                fit_policy_names[config->pet.fit_policy], page_reuse_names[config->pet.page_reuse],
+                config->pet.page_cache_size, config->pet.page_decay_time, config->pet.huge_pages,
+                config->pet.concurrent_pages, config->pet.provision_pages, config->stats_name? config->stats_name : "-", config->stats_interval);
+    }
+}
+
+bool init_allocator_from_env(Allocator* allocator)
+{
+    AllocatorConfig config;
+    default_allocator_config(&config);
+    if (allocator) {
+        config.allocator = allocator;
+    }
+    bool ok = allocator_config_from_env(&config);
+    return configure_allocator(&config) && ok;
+}
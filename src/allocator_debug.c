@@ -4,10 +4,24 @@
 #include <string.h>
 
 #include "allocator.h"
+#include "async_log.h"
 #include "dump.h"
+#include "size_profile.h"
+#include "usdt.h"
 
 static AllocatorStats stats = {};
 
+/*
+ * USDT probes, see usdt.h:
+ *
+ *   debug_allocate  addr or 0 if failed, nbytes
+ *   debug_release   addr, nbytes
+ *   debug_damage    addr, nbytes, damaged bytes below, damaged bytes above
+ */
+USDT_SEMAPHORE(pussy, debug_allocate);
+USDT_SEMAPHORE(pussy, debug_release);
+USDT_SEMAPHORE(pussy, debug_damage);
+
 #define BUBBLEWRAP  32  // the number of bytes around allocated block
 
 typedef struct {
@@ -33,6 +47,16 @@ static uint8_t* block_from_region(uint8_t* region_start)
     return region_start + sizeof(MemBlockInfo) + BUBBLEWRAP;
 }
 
+static void dump_damage(uint8_t* redzone)
+/*
+ * Print damaged rows of redzone against the pattern.
+ */
+{
+    uint8_t pattern[BUBBLEWRAP];
+    memset(pattern, 0xFF, BUBBLEWRAP);
+    dump_hex_diff(stderr, 0, pattern, redzone, BUBBLEWRAP, redzone);
+}
+
 static void check_region(const char* caller_name, void* block, unsigned nbytes)
 {
     unsigned memsize = calc_memsize(nbytes);
@@ -56,26 +80,37 @@ static void check_region(const char* caller_name, void* block, unsigned nbytes)
     }
 
     if (num_damaged_upper || num_damaged_lower) {
+        USDT_PROBE4(pussy, debug_damage, block, nbytes, num_damaged_lower, num_damaged_upper);
+        // dumps are written to stderr directly, flush the log before them
         if (num_damaged_upper && num_damaged_lower) {
-            fprintf(stderr, "%s: damaged %u bytes below %p and %u bytes above %u\n",
-                    caller_name, num_damaged_lower, block, num_damaged_upper, nbytes);
-            dump_hex_simple(stderr, region_start, BUBBLEWRAP);
-            dump_hex_simple(stderr, block_end, BUBBLEWRAP);
+            log_printf("%s: damaged %u bytes below %p and %u bytes above %u\n",
+                       caller_name, num_damaged_lower, block, num_damaged_upper, nbytes);
+            log_flush();
+            dump_damage(region_start + sizeof(MemBlockInfo));
+            dump_damage(block_end);
         } else if (num_damaged_upper) {
-            fprintf(stderr, "%s: damaged %u bytes above %p + %u\n",
-                    caller_name, num_damaged_upper, block, nbytes);
-            dump_hex_simple(stderr, block_end, BUBBLEWRAP);
+            log_printf("%s: damaged %u bytes above %p + %u\n",
+                       caller_name, num_damaged_upper, block, nbytes);
+            log_flush();
+            dump_damage(block_end);
         } else {
-            fprintf(stderr, "%s: damaged %u bytes below %p\n",
-                    caller_name, num_damaged_lower, block);
-            dump_hex_simple(stderr, region_start, BUBBLEWRAP);
+            log_printf("%s: damaged %u bytes below %p\n",
+                       caller_name, num_damaged_lower, block);
+            log_flush();
+            dump_damage(region_start + sizeof(MemBlockInfo));
         }
         exit(1);
     }
 }
 
 static void* _allocate(unsigned nbytes, bool clean)
+/*
+ * Also serves reallocate(), so it records sizes for both.
+ */
 {
+    if (stats.size_profile) {
+        size_profile_record(stats.size_profile, nbytes);
+    }
     unsigned memsize = calc_memsize(nbytes);
 
     uint8_t* region_start;
@@ -85,6 +120,7 @@ static void* _allocate(unsigned nbytes, bool clean)
         region_start = malloc(memsize);
     }
     if (!region_start) {
+        USDT_PROBE2(pussy, debug_allocate, 0, nbytes);
         return nullptr;
     }
     uint8_t* region_end  = region_start + memsize;
@@ -92,8 +128,8 @@ static void* _allocate(unsigned nbytes, bool clean)
     uint8_t* block_end   = block_start + nbytes;
 
     if (region_end <= block_end) {
-        fprintf(stderr, "%s: region_end %p must be greater than block_end %p\n",
-                __func__, region_end, block_end);
+        log_printf("%s: region_end %p must be greater than block_end %p\n",
+                   __func__, region_end, block_end);
         exit(1);
     }
 
@@ -105,9 +141,10 @@ static void* _allocate(unsigned nbytes, bool clean)
     info->nbytes = nbytes;
 
     atomic_fetch_add(&stats.blocks_allocated, 1);
+    USDT_PROBE2(pussy, debug_allocate, block_start, nbytes);
 
     if (debug_allocator.verbose) {
-        printf("%s: %u bytes -> %p\n", __func__, nbytes, block_start);
+        log_printf("%s: %u bytes -> %p\n", __func__, nbytes, block_start);
     }
     return block_start;
 }
@@ -120,11 +157,12 @@ static void _release(void** addr_ptr, unsigned nbytes)
     }
 
     check_region(__func__, addr, nbytes);
+    USDT_PROBE2(pussy, debug_release, addr, nbytes);
 
     free(region_from_block(addr));
 
     if (debug_allocator.verbose) {
-        fprintf(stderr, "%s: %p %u bytes\n", __func__, addr, nbytes);
+        log_printf("%s: %p %u bytes\n", __func__, addr, nbytes);
     }
     atomic_fetch_sub(&stats.blocks_allocated, 1);
 
@@ -3,6 +3,7 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdarg.h>
 //#include <stdbit.h> not in libc yet, using __builtin_* functions
@@ -10,75 +11,47 @@
 #include <stdlib.h>
 #include <string.h>
 #include <threads.h>
+#include <time.h>
 #include <sys/mman.h>
 
 #include "allocator.h"
+#include "async_log.h"
+#include "bitset.h"
 #include "dump.h"
+#include "pet_snapshot.h"
+#include "pet_stats.h"
+#include "size_profile.h"
+#include "sync.h"
+#include "usdt.h"
 
 // unit size should not be less than size of pointer
 #define UNIT_SIZE  16
 
-// threads serialization
-static mtx_t lock;
-
-/****************************************************************
- * Architecture-specific definitions.
- */
-#if (PTRDIFF_WIDTH == 32) && (UINT_WIDTH >= 32)
-
-    typedef uint32_t Word;
-#   define WORD_WIDTH  32
-#   define WORD_MAX    0xFFFF'FFFF
-
-#elif PTRDIFF_WIDTH == 64
-
-    // on 64-bit architecture Word is configurable with WORD_WIDTH, default is 64.
-
-#   if defined(WORD_WIDTH) && (WORD_WIDTH == 32)
-
-        typedef uint32_t Word;
-#       define WORD_WIDTH  32
-#       define WORD_MAX    0xFFFF'FFFF
-
-#   else
-        typedef uint64_t Word;
-#       define WORD_WIDTH  64
-#       define WORD_MAX    0xFFFF'FFFF'FFFF'FFFF
-
-#   endif
-
-#else
-#   error Cannot define architecture-specific stuff. Please revise.
-#endif
+// the size of transparent huge page on x86-64 and arm64 with 4K pages
+#define HUGE_PAGE_SIZE  (2 * 1024 * 1024)
 
-#if WORD_WIDTH == 32
+PetTunables pet_tunables = {};
 
-    static inline Word count_trailing_zeros(Word value)
-    {
-        //return  stdc_trailing_zeros(value);
-        return  __builtin_ctz(value);
-    }
-
-#else
-
-    static inline Word count_trailing_zeros(Word value)
-    {
-        //return  stdc_trailing_zeros(value);
-        return  __builtin_ctzl(value);
-    }
-
-#endif
+// threads serialization
+static mtx_t lock;
+static cnd_t page_returned;      // signalled when pages are linked to superblock while someone waits
+static unsigned page_waiters = 0;  // threads waiting in grab_superblock_page, updated under the lock
 
 /****************************************************************
  * Trace/debug output
  */
 
 static void print_msg(const char* func_name, char* fmt, ...)
+/*
+ * Messages are written by the async logger, so that error or trace storms
+ * do not stall allocations on stderr.
+ */
 {
-    fprintf(stderr, "Bitmap allocator -- %s: ", func_name);
+    char prefix[80];
+    snprintf(prefix, sizeof(prefix), "Bitmap allocator -- %s: ", func_name);
     va_list ap;
     va_start(ap);
-    vfprintf(stderr, fmt, ap);
+    log_vprintf(prefix, fmt, ap);
     va_end(ap);
 }
 
@@ -92,6 +65,29 @@ static void print_msg(const char* func_name, char* fmt, ...)
 #   define TRACE(...)
 #endif
 
+/*
+ * USDT probes, see usdt.h:
+ *
+ *   pet_mmap            addr or 0 if failed, size
+ *   pet_munmap          addr, size
+ *   pet_mremap          old addr, new addr, old size, new size
+ *   pet_grow_fail       addr, old nbytes, new nbytes: block cannot grow in place
+ *   pet_page_new        bm page, lifetime, 1 if taken from the cache
+ *   pet_page_grab       bm page, superblock list it was taken from
+ *   pet_page_empty      bm page, before it's cached or unmapped
+ *   pet_provision       number of pages to map ahead of demand
+ *   pet_lock_contended  superblock lock is busy
+ */
+USDT_SEMAPHORE(pussy, pet_mmap);
+USDT_SEMAPHORE(pussy, pet_munmap);
+USDT_SEMAPHORE(pussy, pet_mremap);
+USDT_SEMAPHORE(pussy, pet_grow_fail);
+USDT_SEMAPHORE(pussy, pet_page_new);
+USDT_SEMAPHORE(pussy, pet_page_grab);
+USDT_SEMAPHORE(pussy, pet_page_empty);
+USDT_SEMAPHORE(pussy, pet_provision);
+USDT_SEMAPHORE(pussy, pet_lock_contended);
+
 
 /****************************************************************
  * Stats
@@ -101,6 +97,35 @@ static AllocatorStats stats = {};
 
 static atomic_size_t num_bm_pages = 0;
 
+// occupancy of page sets
+static atomic_size_t lifetime_pages[PET_NUM_LIFETIMES] = {};
+static atomic_size_t lifetime_units[PET_NUM_LIFETIMES] = {};
+
+// blocks allocated directly with mmap
+static atomic_size_t num_large_blocks = 0;
+static atomic_size_t large_mapped_bytes = 0;
+
+// updated under the lock
+static size_t lock_acquisitions = 0;
+static size_t lock_contentions = 0;
+static unsigned* lfb_population;  // number of pages in each superblock entry
+static unsigned num_cached_pages = 0;  // empty pages kept mapped
+
+static inline void lock_superblock()
+{
+    if (mtx_trylock(&lock) != thrd_success) {
+        USDT_PROBE0(pussy, pet_lock_contended);
+        mtx_lock(&lock);
+        lock_contentions++;
+    }
+    lock_acquisitions++;
+}
+
+static inline void unlock_superblock()
+{
+    mtx_unlock(&lock);
+}
+
 /****************************************************************
  * memory cleaning
  */
@@ -149,6 +174,15 @@ static void cleanse(void* addr, unsigned start, unsigned end)
  * mmap/mremap/munmap wrappers
  */
 
+static inline void advise_huge_pages(void* addr, unsigned size)
+{
+    if (pet_tunables.huge_pages && size >= HUGE_PAGE_SIZE) {
+        if (madvise(addr, size, MADV_HUGEPAGE) == -1) {
+            SAY("madvise(%p, %u, MADV_HUGEPAGE): %s\n", addr, size, strerror(errno));
+        }
+    }
+}
+
 static void* call_mmap(unsigned size, bool clean)
 /*
  * call mmap to allocate pages
@@ -162,8 +196,11 @@ static void* call_mmap(unsigned size, bool clean)
     void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
     if (result == MAP_FAILED) {
         ERR("mmap: %s\n", strerror(errno));
+        USDT_PROBE2(pussy, pet_mmap, 0, size);
         return nullptr;
     }
+    USDT_PROBE2(pussy, pet_mmap, result, size);
+    advise_huge_pages(result, size);
     if (clean) {
         cleanse(result, 0, size);
     }
@@ -172,6 +209,7 @@ static void* call_mmap(unsigned size, bool clean)
 
 static inline void call_munmap(void* addr, unsigned size)
 {
+    USDT_PROBE2(pussy, pet_munmap, addr, size);
     if (munmap(addr, size) == -1) {
         ERR("munmap(%p, %u): %s\n", addr, size, strerror(errno));
     }
@@ -202,12 +240,19 @@ static void* call_mremap(void* addr, unsigned old_nbytes, unsigned new_nbytes, b
         ERR("mremap(%p, %u, %u): %s\n", addr, old_size, new_size, strerror(errno));
         if (new_size > old_size) {
             // grow failed
+            USDT_PROBE3(pussy, pet_grow_fail, addr, old_nbytes, new_nbytes);
             return nullptr;
         } else {
             // shrink failed, return same address
             return addr;
         }
     }
+    USDT_PROBE4(pussy, pet_mremap, addr, new_addr, old_size, new_size);
+    atomic_fetch_add(&large_mapped_bytes, new_size);
+    atomic_fetch_sub(&large_mapped_bytes, old_size);
+    if (new_size > old_size) {
+        advise_huge_pages(new_addr, new_size);
+    }
     if (clean) {
         cleanse(new_addr, old_nbytes, new_nbytes);
     }
@@ -230,6 +275,26 @@ static unsigned bm_page_header_size_in_units; // num_reserved_units ???
 
 static unsigned max_data_units;  // sys_page_size - bm_page_header_size_in_units
 
+#ifdef PET_PAGE_SIZE
+    /*
+     * Page geometry fixed at build time, so that bitmap search loops have
+     * constant trip count and get unrolled. It's used only if the system
+     * page size is the same, otherwise the geometry calculated at runtime is used.
+     */
+    static_assert(PET_PAGE_SIZE % (UNIT_SIZE * WORD_WIDTH) == 0);
+
+#   define FIXED_UNITS_PER_PAGE  (PET_PAGE_SIZE / UNIT_SIZE)
+#   define FIXED_HEADER_UNITS    ((offsetof(BmPageHeader, bitmap) + FIXED_UNITS_PER_PAGE / 8 + UNIT_SIZE - 1) \
+                                  / UNIT_SIZE)
+#   define FIXED_GEOMETRY        fixed_geometry
+
+    static bool fixed_geometry = false;  // set by _init
+#else
+#   define FIXED_UNITS_PER_PAGE  0
+#   define FIXED_HEADER_UNITS    0
+#   define FIXED_GEOMETRY        false
+#endif
+
 
 static inline unsigned bytes_to_units(unsigned nbytes)
 {
@@ -247,6 +312,13 @@ typedef struct _BmPageHeader {
     struct _BmPageHeader** list;
     struct _BmPageHeader* next;
     struct _BmPageHeader* prev;
+    // 16 bits are enough for units of 64K pages
+    uint16_t cursor;    // end of the last allocated block, for next fit
+    uint16_t lifetime;  // PetLifetime, the page belongs to its superblock
+
+    // used in concurrent mode only
+    atomic_ushort users;       // threads that may access the page without owning a block in it
+    atomic_ushort num_blocks;  // blocks allocated in the page
 
     // variable part
 
@@ -256,7 +328,7 @@ typedef struct _BmPageHeader {
 } BmPageHeader;
 
 
-static BmPageHeader** superblock;
+static BmPageHeader** superblocks[PET_NUM_LIFETIMES];
 /*
  * Straightforward definition would be:
  *
@@ -265,10 +337,43 @@ static BmPageHeader** superblock;
  * The array contains pointers to bm_page lists grouped by their
  * longest free block.
  *
+ * Each lifetime has its own superblock, they are allocated together.
  * Superblock cannot take more than one page.
  * Usually it takes a half, if UNIT_SIZE is twice longer than size of pointer.
  */
 
+static inline BmPageHeader** page_superblock(BmPageHeader* bm_page)
+{
+    return superblocks[bm_page->lifetime];
+}
+
+static inline unsigned page_list_lfb(BmPageHeader* bm_page)
+/*
+ * The longest free block according to the list the page is in.
+ */
+{
+    return bm_page->list - page_superblock(bm_page);
+}
+
+static thread_local PetLifetime lifetime_hint = PET_TRANSIENT;
+
+/*
+ * Hot pages for concurrent mode, see Concurrent pages section below.
+ */
+
+#define HOT_MAX_UNITS       16  // must not exceed WORD_WIDTH
+#define MAX_RECLAIM_YIELDS  8
+#define CACHE_LINE_SIZE     64
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) _Atomic(BmPageHeader*) page;
+    atomic_uint readers;  // threads between loading `page` and incrementing its users
+} HotSlot;
+
+static bool concurrent_pages = false;  // pet_tunables.concurrent_pages at init
+
+static HotSlot hot_slots[PET_NUM_LIFETIMES][HOT_MAX_UNITS];  // indexed by lifetime and num_units - 1
+
 static void dump_bm_page(BmPageHeader* bm_page)
 {
     fprintf(stderr, "Page %p: list=%p, next=%p, prev=%p\n",
@@ -278,197 +383,490 @@ static void dump_bm_page(BmPageHeader* bm_page)
 
 static void dump()
 {
-    BmPageHeader** list = superblock;
+    // the dump goes to stderr directly, write out pending messages first
+    log_flush();
     fprintf(stderr, "\nAllocator bm pages: %zu, blocks allocated %zu\n",
             num_bm_pages, stats.blocks_allocated);
-    for (unsigned i = 0; i < units_per_page; i++, list++) {
-        BmPageHeader* first_page = *list;
-        if (first_page) {
-            fprintf(stderr, "Superblock entry %u: %p -> %p\n", i, list, first_page);
-            BmPageHeader* bm_page = first_page;
-            do {
-                dump_bm_page(bm_page);
-                bm_page = bm_page->next;
-            } while (bm_page != first_page);
+    for (unsigned lifetime = 0; lifetime < PET_NUM_LIFETIMES; lifetime++) {
+        fprintf(stderr, "Lifetime %u: %zu pages, %zu units allocated\n",
+                lifetime, lifetime_pages[lifetime], lifetime_units[lifetime]);
+        BmPageHeader** list = superblocks[lifetime];
+        for (unsigned i = 0; i < units_per_page; i++, list++) {
+            BmPageHeader* first_page = *list;
+            if (first_page) {
+                fprintf(stderr, "Superblock entry %u: %p -> %p\n", i, list, first_page);
+                BmPageHeader* bm_page = first_page;
+                do {
+                    dump_bm_page(bm_page);
+                    bm_page = bm_page->next;
+                } while (bm_page != first_page);
+            }
         }
     }
     fputc('\n', stderr);
 }
 
 /****************************************************************
- * Basic bitmap functions
+ * Snapshot
  */
 
-static unsigned count_zero_bits(BmPageHeader* bm_page, unsigned offset, unsigned limit)
+static bool write_full(int fd, void* data, size_t size)
+{
+    uint8_t* p = data;
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ERR("write: %s\n", strerror(errno));
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static uint8_t* write_page_record(uint8_t* p, BmPageHeader* bm_page, unsigned lfb)
+{
+    PetSnapshotPage* record = (PetSnapshotPage*) p;
+    record->addr = (uint64_t) (ptrdiff_t) bm_page;
+    record->lfb = lfb;
+    record->lifetime = bm_page->lifetime;
+    memcpy(p + sizeof(PetSnapshotPage), bm_page->bitmap, units_per_page / 8);
+    return p + sizeof(PetSnapshotPage) + units_per_page / 8;
+}
+
+bool pet_snapshot(int fd)
 /*
- * Count consecutive zero bits in the bitmap starting from `offset` bit
- * up to `limit`. The limit is treated as a hint when to stop, returned count can be greater.
+ * Page records are copied to a buffer under the lock and written after unlocking
+ * so that allocations are not blocked by I/O.
  */
 {
-    unsigned count = 0;
-    Word* ptr = &bm_page->bitmap[offset / WORD_WIDTH];
-
-    // count starting bits up to the the next word boundary
-    unsigned bit_index = offset & (WORD_WIDTH - 1);
-    if (bit_index) {
-        Word w = *ptr++;
-        w >>= bit_index;
-        if (w) {
-            // we have only ending bits
-            return count_trailing_zeros(w);
+    unsigned bitmap_size = units_per_page / 8;
+    size_t record_size = sizeof(PetSnapshotPage) + bitmap_size;
+
+    // leave some room for pages added while the buffer is being allocated
+    size_t capacity = num_bm_pages + 64;
+    size_t buffer_size;
+    uint8_t* buffer;
+
+    for (;;) {
+        buffer_size = sizeof(PetSnapshotHeader) + capacity * record_size;
+        buffer_size = (buffer_size + sys_page_size - 1) & ~((size_t) sys_page_size - 1);
+
+        // call_mmap takes unsigned size, so map directly
+        buffer = mmap(nullptr, buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffer == MAP_FAILED) {
+            ERR("mmap: %s\n", strerror(errno));
+            return false;
+        }
+        lock_superblock();
+        /*
+         * Pages are counted before they are added to the superblock or hot slots
+         * and uncounted after they are taken out, so under the lock num_bm_pages
+         * is not less than the number of pages to record.
+         */
+        size_t n = num_bm_pages;
+        if (n <= capacity) {
+            break;
         }
-        count = WORD_WIDTH - bit_index;
-        offset += count;
+        // the heap grew meanwhile
+        unlock_superblock();
+        munmap(buffer, buffer_size);
+        capacity = n + n / 8 + 64;
     }
 
-    // count zero words
-    while (offset < units_per_page && count < limit) {
-        Word w = *ptr++;
-        if (w) {
-            // count ending bits
-            count += count_trailing_zeros(w);
-            break;
+    PetSnapshotHeader* header = (PetSnapshotHeader*) buffer;
+    memcpy(header->magic, PET_SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version        = PET_SNAPSHOT_VERSION;
+    header->page_size      = sys_page_size;
+    header->unit_size      = UNIT_SIZE;
+    header->units_per_page = units_per_page;
+    header->header_units   = bm_page_header_size_in_units;
+    header->bitmap_size    = bitmap_size;
+
+    uint8_t* p = buffer + sizeof(PetSnapshotHeader);
+    size_t num_pages = 0;
+
+    for (unsigned lifetime = 0; lifetime < PET_NUM_LIFETIMES; lifetime++) {
+        for (unsigned lfb = 0; lfb < units_per_page; lfb++) {
+            BmPageHeader* first_page = superblocks[lifetime][lfb];
+            if (!first_page) {
+                continue;
+            }
+            BmPageHeader* bm_page = first_page;
+            do {
+                p = write_page_record(p, bm_page, lfb);
+                num_pages++;
+                bm_page = bm_page->next;
+            } while (bm_page != first_page);
+        }
+        for (unsigned i = 0; i < HOT_MAX_UNITS; i++) {
+            // hot pages are out of superblock, record their actual longest free block
+            BmPageHeader* bm_page = atomic_load(&hot_slots[lifetime][i].page);
+            if (bm_page) {
+                p = write_page_record(p, bm_page, bitset_longest_zeros(bm_page->bitmap, units_per_page,
+                                                                       bm_page_header_size_in_units));
+                num_pages++;
+            }
         }
-        count += WORD_WIDTH;
-        offset += WORD_WIDTH;
     }
-    return count;
+    header->num_pages          = num_pages;
+    header->num_bm_pages       = num_bm_pages;
+    header->blocks_allocated   = stats.blocks_allocated;
+    header->num_large_blocks   = num_large_blocks;
+    header->large_mapped_bytes = large_mapped_bytes;
+    unlock_superblock();
+
+    bool result = write_full(fd, buffer, p - buffer);
+    munmap(buffer, buffer_size);
+    return result;
 }
 
-static unsigned count_nonzero_bits(BmPageHeader* bm_page, unsigned offset, unsigned limit)
+/****************************************************************
+ * Stats published in shared memory
+ */
+
+static PetSharedStats* shared_stats = nullptr;
+static unsigned shared_stats_size;
+static char* shared_stats_name = nullptr;
+static unsigned shared_stats_name_size;
+static Event* stop_publisher;
+static thrd_t publisher_thread;
+static unsigned* lfb_population_copy;  // taken under the lock by the publisher
+
+static void update_shared_stats()
 /*
- * Count consecutive nonzero bits in the bitmap starting from `offset` bit
- * up to `limit`. The limit is treated as a hint when to stop, returned count can be greater.
- *
- * The code is exactly the same as in count_zero_bits, the only difference is inversion.
+ * Values protected by the lock are copied before the update begins,
+ * so readers never wait for the lock to be released.
+ * The lock is taken directly, so the publisher is not counted in lock stats.
  */
 {
-    unsigned count = 0;
-    Word* ptr = &bm_page->bitmap[offset / WORD_WIDTH];
+    mtx_lock(&lock);
+    size_t cached_pages = num_cached_pages;
+    size_t acquisitions = lock_acquisitions;
+    size_t contentions  = lock_contentions;
+    memcpy(lfb_population_copy, lfb_population, units_per_page * sizeof(unsigned));
+    mtx_unlock(&lock);
 
-    // count starting bits up to the the next word boundary
-    unsigned bit_index = offset & (WORD_WIDTH - 1);
-    if (bit_index) {
-        Word w = ~*ptr++;
-        w >>= bit_index;
-        if (w) {
-            // we have only ending bits
-            return count_trailing_zeros(w);
-        }
-        count = WORD_WIDTH - bit_index;
-        offset += count;
+    PetSharedStats* s = shared_stats;
+    unsigned seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    s->update_count++;
+    s->blocks_allocated   = stats.blocks_allocated;
+    s->num_bm_pages       = num_bm_pages;
+    s->num_large_blocks   = num_large_blocks;
+    s->mapped_bytes       = (num_bm_pages + cached_pages) * sys_page_size + large_mapped_bytes;
+    s->lock_acquisitions  = acquisitions;
+    s->lock_contentions   = contentions;
+    for (unsigned i = 0; i < PET_NUM_LIFETIMES; i++) {
+        s->lifetime_pages[i] = lifetime_pages[i];
+        s->lifetime_units[i] = lifetime_units[i];
     }
+    memcpy(s->lfb_population, lfb_population_copy, units_per_page * sizeof(unsigned));
 
-    // count all-one words
-    while (offset < units_per_page && count < limit) {
-        Word w = ~*ptr++;
-        if (w) {
-            // count ending bits
-            count += count_trailing_zeros(w);
-            break;
-        }
-        count += WORD_WIDTH;
-        offset += WORD_WIDTH;
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+static int publisher(void* arg)
+{
+    double interval = *(double*) arg;
+    release((void**) &arg, sizeof(double));
+    // wait_event returns true on spurious wakeups, so check the flag itself
+    while (!event_is_set(stop_publisher)) {
+        update_shared_stats();
+        wait_event(stop_publisher, interval);
     }
-    return count;
+    update_shared_stats();
+    return 0;
 }
 
-static void set_bits(BmPageHeader* bm_page, unsigned offset, unsigned length)
-/*
- * Set bits in the bitmap starting from offset.
- */
+bool pet_publish_stats(char* name, double interval)
 {
-    TRACE("bm_page=%p offset=%u length=%u\n", bm_page, offset, length);
-    Word* ptr = &bm_page->bitmap[offset / WORD_WIDTH];
+    static_assert(sizeof(unsigned) == sizeof(uint32_t));
 
-    // set starting bits up to the the next word boundary
-    unsigned bit_index = offset & (WORD_WIDTH - 1);
-    if (bit_index) {
-        Word bitmask = WORD_MAX;
-        unsigned num_bits = WORD_WIDTH - bit_index;
-        if (length <= num_bits) {
-            bitmask &= (((Word) 1) << length) - 1;
-            num_bits = length;
-        }
-        bitmask <<= bit_index;
-        *ptr++ |= bitmask;
-        offset += num_bits;
-        length -= num_bits;
+    if (shared_stats) {
+        ERR("stats are already published as %s\n", shared_stats_name);
+        return false;
     }
+    shared_stats_size = align_unsigned_to_page(sizeof(PetSharedStats) + units_per_page * sizeof(uint32_t));
 
-    // set remaining words
-    while (length >= WORD_WIDTH) {
-        *ptr++ = WORD_MAX;
-        length -= WORD_WIDTH;
+    int fd = shm_open(name, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    if (fd == -1) {
+        ERR("shm_open(%s): %s\n", name, strerror(errno));
+        return false;
+    }
+    if (ftruncate(fd, shared_stats_size) == -1) {
+        ERR("ftruncate: %s\n", strerror(errno));
+        goto error_unlink;
+    }
+    shared_stats = mmap(nullptr, shared_stats_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shared_stats == MAP_FAILED) {
+        ERR("mmap: %s\n", strerror(errno));
+        shared_stats = nullptr;
+        goto error_unlink;
     }
+    close(fd);
+    fd = -1;
 
-    // set ending bits
-    if (length) {
-        *ptr++ |= (((Word) 1) << length) - 1;
+    shared_stats->page_size = sys_page_size;
+    shared_stats->unit_size = UNIT_SIZE;
+    shared_stats->num_lfb_buckets = units_per_page;
+
+    shared_stats_name_size = strlen(name) + 1;
+    shared_stats_name = allocate(shared_stats_name_size, false);
+    if (shared_stats_name) {
+        memcpy(shared_stats_name, name, shared_stats_name_size);
+    }
+    lfb_population_copy = allocate(units_per_page * sizeof(unsigned), false);
+    stop_publisher = create_event();
+    double* arg = allocate(sizeof(double), false);
+    if (!shared_stats_name || !lfb_population_copy || !stop_publisher || !arg) {
+        ERR("out of memory\n");
+        release((void**) &arg, sizeof(double));
+        goto error_unmap;
+    }
+    *arg = interval;
+    if (thrd_create(&publisher_thread, publisher, arg) != thrd_success) {
+        ERR("cannot create publisher thread\n");
+        release((void**) &arg, sizeof(double));
+        goto error_unmap;
+    }
+    return true;
+
+error_unmap:
+    delete_event(&stop_publisher);
+    release((void**) &lfb_population_copy, units_per_page * sizeof(unsigned));
+    release((void**) &shared_stats_name, shared_stats_name_size);
+    munmap(shared_stats, shared_stats_size);
+    shared_stats = nullptr;
+
+error_unlink:
+    if (fd != -1) {
+        close(fd);
+    }
+    shm_unlink(name);
+    return false;
+}
+
+void pet_unpublish_stats()
+{
+    if (!shared_stats) {
+        return;
     }
+    set_event(stop_publisher);
+    thrd_join(publisher_thread, nullptr);
+    delete_event(&stop_publisher);
+
+    munmap(shared_stats, shared_stats_size);
+    shared_stats = nullptr;
+    shm_unlink(shared_stats_name);
+    release((void**) &shared_stats_name, shared_stats_name_size);
+    release((void**) &lfb_population_copy, units_per_page * sizeof(unsigned));
+}
+
+/****************************************************************
+ * Basic bitmap functions
+ */
+
+static inline unsigned bitmap_words()
+{
+    return (FIXED_GEOMETRY? FIXED_UNITS_PER_PAGE : units_per_page) / WORD_WIDTH;
+}
+
+static inline unsigned count_zero_bits(BmPageHeader* bm_page, unsigned offset, unsigned limit)
+/*
+ * Count consecutive zero bits in the bitmap starting from `offset` bit
+ * up to `limit`. The limit is treated as a hint when to stop, returned count can be greater.
+ */
+{
+    return bitset_count_zeros(bm_page->bitmap, units_per_page, offset, limit);
+}
+
+static inline unsigned count_nonzero_bits(BmPageHeader* bm_page, unsigned offset, unsigned limit)
+/*
+ * Count consecutive nonzero bits in the bitmap starting from `offset` bit
+ * up to `limit`. The limit is treated as a hint when to stop, returned count can be greater.
+ */
+{
+    return bitset_count_ones(bm_page->bitmap, units_per_page, offset, limit);
 }
 
-static void clear_bits(BmPageHeader* bm_page, unsigned offset, unsigned length)
+static inline void set_bits(BmPageHeader* bm_page, unsigned offset, unsigned length)
+/*
+ * Set bits in the bitmap starting from offset.
+ */
+{
+    TRACE("bm_page=%p offset=%u length=%u\n", bm_page, offset, length);
+    bitset_set_range(bm_page->bitmap, offset, length);
+}
+
+static inline void clear_bits(BmPageHeader* bm_page, unsigned offset, unsigned length)
 /*
  * Clear bits in the bitmap starting from offset.
- *
- * The logic is the same as in set_bits.
  */
 {
     TRACE("bm_page=%p offset=%u length=%u\n", bm_page, offset, length);
-    Word* ptr = &bm_page->bitmap[offset / WORD_WIDTH];
+    bitset_clear_range(bm_page->bitmap, offset, length);
+}
+
+/*
+ * Atomic versions for concurrent mode, see below.
+ * Bitmap is accessed as an array of atomic words.
+ */
+
+static inline Word word_mask(unsigned bit, unsigned length)
+{
+    return ((length == WORD_WIDTH)? WORD_MAX : ((Word) 1 << length) - 1) << bit;
+}
+
+static void atomic_clear_bits(BmPageHeader* bm_page, unsigned offset, unsigned length)
+{
+    TRACE("bm_page=%p offset=%u length=%u\n", bm_page, offset, length);
 
-    // clear starting bits up to the the next word boundary
-    unsigned bit_index = offset & (WORD_WIDTH - 1);
-    if (bit_index) {
-        Word bitmask = WORD_MAX;
-        unsigned num_bits = WORD_WIDTH - bit_index;
-        if (length <= num_bits) {
-            bitmask &= (((Word) 1) << length) - 1;
-            num_bits = length;
+    _Atomic Word* word = (_Atomic Word*) &bm_page->bitmap[offset / WORD_WIDTH];
+    unsigned bit = offset % WORD_WIDTH;
+    while (length) {
+        unsigned n = WORD_WIDTH - bit;
+        if (n > length) {
+            n = length;
         }
-        bitmask <<= bit_index;
-        *ptr++ &= ~bitmask;
-        offset += num_bits;
-        length -= num_bits;
+        atomic_fetch_and(word, ~word_mask(bit, n));
+        word++;
+        bit = 0;
+        length -= n;
     }
+}
 
-    // clear remaining words
-    while (length >= WORD_WIDTH) {
-        *ptr++ = 0;
-        length -= WORD_WIDTH;
+static bool claim_bits(BmPageHeader* bm_page, unsigned offset, unsigned length)
+/*
+ * Atomically set bits that are expected to be clear.
+ * If any of them turns out to be set, restore the state and return false.
+ */
+{
+    TRACE("bm_page=%p offset=%u length=%u\n", bm_page, offset, length);
+
+    _Atomic Word* word = (_Atomic Word*) &bm_page->bitmap[offset / WORD_WIDTH];
+    unsigned bit = offset % WORD_WIDTH;
+    unsigned claimed = 0;
+    while (claimed < length) {
+        unsigned n = WORD_WIDTH - bit;
+        if (n > length - claimed) {
+            n = length - claimed;
+        }
+        Word mask = word_mask(bit, n);
+        Word w = atomic_load_explicit(word, memory_order_relaxed);
+        do {
+            if (w & mask) {
+                atomic_clear_bits(bm_page, offset, claimed);
+                return false;
+            }
+        } while (!atomic_compare_exchange_weak(word, &w, w | mask));
+        word++;
+        bit = 0;
+        claimed += n;
     }
+    return true;
+}
 
-    // clear ending bits
-    if (length) {
-        *ptr++ &= ~((((Word) 1) << length) - 1);
+static unsigned claim_bits_in_word(BmPageHeader* bm_page, unsigned length)
+/*
+ * Find `length` clear bits within a single bitmap word and atomically set them.
+ * Return offset of the block or 0 if no word has room for it.
+ */
+{
+    _Atomic Word* bitmap = (_Atomic Word*) bm_page->bitmap;
+    Word mask = word_mask(0, length);
+    for (unsigned i = 0, n = bitmap_words(); i < n; i++) {
+        Word w = atomic_load_explicit(&bitmap[i], memory_order_relaxed);
+        for (;;) {
+            // bit k of candidates is set if `length` bits starting from k are clear
+            Word candidates = ~w;
+            for (unsigned k = 1; k < length && candidates; k++) {
+                candidates &= ~w >> k;
+            }
+            if (!candidates) {
+                break;
+            }
+            unsigned bit = count_trailing_zeros(candidates);
+            if (atomic_compare_exchange_weak(&bitmap[i], &w, w | (mask << bit))) {
+                TRACE("bm_page=%p length=%u -> offset=%u\n", bm_page, length, i * WORD_WIDTH + bit);
+                return i * WORD_WIDTH + bit;
+            }
+        }
     }
+    return 0;
 }
 
 /****************************************************************
  * Bitmap allocator functions
  */
 
+/*
+ * Bitmap search with fixed or runtime geometry.
+ */
+
+static inline unsigned header_units()
+{
+    return FIXED_GEOMETRY? FIXED_HEADER_UNITS : bm_page_header_size_in_units;
+}
+
+static inline unsigned find_zeros(BmPageHeader* bm_page, unsigned offset, unsigned length)
+{
+    if (FIXED_GEOMETRY) {
+        return bitset_find_zeros_words(bm_page->bitmap, FIXED_UNITS_PER_PAGE / WORD_WIDTH, offset, length);
+    }
+    return bitset_find_zeros(bm_page->bitmap, units_per_page, offset, length);
+}
+
+static inline unsigned find_best_zeros(BmPageHeader* bm_page, unsigned offset, unsigned length)
+{
+    if (FIXED_GEOMETRY) {
+        return bitset_find_best_zeros_words(bm_page->bitmap, FIXED_UNITS_PER_PAGE / WORD_WIDTH, offset, length);
+    }
+    return bitset_find_best_zeros(bm_page->bitmap, units_per_page, offset, length);
+}
+
+static inline unsigned longest_zeros(BmPageHeader* bm_page)
+{
+    if (FIXED_GEOMETRY) {
+        return bitset_longest_zeros_words(bm_page->bitmap, FIXED_UNITS_PER_PAGE / WORD_WIDTH, FIXED_HEADER_UNITS);
+    }
+    return bitset_longest_zeros(bm_page->bitmap, units_per_page, bm_page_header_size_in_units);
+}
+
 static unsigned find_free_block(BmPageHeader* bm_page, unsigned block_size)
 /*
- * Search for free block.
- * Return offset of the first available block or 0 if no block is found.
+ * Search for free block according to the fit policy.
+ * Return offset of the block or 0 if no block is found.
  * Given that first units of bm_page are always in use,
  * offset can never be zero on success.
  */
 {
-    unsigned offset = bm_page_header_size_in_units;
-    while (offset < units_per_page) {
-        unsigned length = count_zero_bits(bm_page, offset, block_size);
-        if (length >= block_size) {
-            TRACE("bm_page=%p block_size=%u -> offset=%u\n", bm_page, block_size, offset);
-            return offset;
-        }
-        offset += length;
-        offset += count_nonzero_bits(bm_page, offset, UINT_MAX);
+    unsigned offset;
+    switch (pet_tunables.fit_policy) {
+        case PET_BEST_FIT:
+            offset = find_best_zeros(bm_page, header_units(), block_size);
+            break;
+        case PET_NEXT_FIT:
+            offset = find_zeros(bm_page, bm_page->cursor, block_size);
+            if (offset != BITSET_NOT_FOUND) {
+                break;
+            }
+            [[fallthrough]];
+        default:
+            offset = find_zeros(bm_page, header_units(), block_size);
+            break;
     }
-    TRACE("bm_page=%p block_size=%u -> 0\n", bm_page, block_size);
-    return 0;
+    if (offset == BITSET_NOT_FOUND) {
+        offset = 0;
+    }
+    TRACE("bm_page=%p block_size=%u -> offset=%u\n", bm_page, block_size, offset);
+    return offset;
 }
 
 static unsigned find_longest_free_block(BmPageHeader* bm_page)
@@ -476,29 +874,18 @@ static unsigned find_longest_free_block(BmPageHeader* bm_page)
  * Search for the longest sequence of zero bits and return its length.
  */
 {
-    unsigned offset = bm_page_header_size_in_units;
-    unsigned n = max_data_units;
-    unsigned lfb = 0;
-    while (n) {
-        unsigned length = count_zero_bits(bm_page, offset, n);
-        if (length > lfb) {
-            lfb = length;
-        }
-        offset += length;
-        n -= length;
-
-        length = count_nonzero_bits(bm_page, offset, n);
-        offset += length;
-        n -= length;
-    }
+    unsigned lfb = longest_zeros(bm_page);
     TRACE("bm_page=%p -> lfb=%u\n", bm_page, lfb);
     return lfb;
 }
 
-static void add_to_superblock_entry(BmPageHeader* bm_page, unsigned lfb)
+static void link_to_superblock_entry(BmPageHeader* bm_page, unsigned lfb)
+/*
+ * Should be called under the lock.
+ */
 {
     TRACE("adding bm_page %p to superblock[%u]\n", bm_page, lfb);
-    mtx_lock(&lock);
+    BmPageHeader** superblock = page_superblock(bm_page);
     BmPageHeader* first = superblock[lfb];
     if (first) {
         // add to the end of list
@@ -510,8 +897,23 @@ static void add_to_superblock_entry(BmPageHeader* bm_page, unsigned lfb)
         // init list
         superblock[lfb] = bm_page->next = bm_page->prev = bm_page;
     }
+    if (pet_tunables.page_reuse == PET_REUSE_MRU) {
+        // the list is circular, make the page its head
+        superblock[lfb] = bm_page;
+    }
     bm_page->list = superblock + lfb;
-    mtx_unlock(&lock);
+    lfb_population[lfb]++;
+
+    if (page_waiters) {
+        cnd_broadcast(&page_returned);
+    }
+}
+
+static void add_to_superblock_entry(BmPageHeader* bm_page, unsigned lfb)
+{
+    lock_superblock();
+    link_to_superblock_entry(bm_page, lfb);
+    unlock_superblock();
 }
 
 static inline void add_to_superblock(BmPageHeader* bm_page)
@@ -530,14 +932,16 @@ static void delete_from_list(BmPageHeader* bm_page)
     BmPageHeader** list = bm_page->list;
 
 #   ifdef DEBUG
-        TRACE("deleting page %p from superblock[%u]\n", bm_page, list - superblock);
+        TRACE("deleting page %p from superblock[%u]\n", bm_page, page_list_lfb(bm_page));
         if (!list) {
             ERR("double call delete_from_list(%p)\n", bm_page);
-            abort();
+            log_flush_and_abort();
         }
 #   endif
 
-    if (bm_page->next == bm_page->prev) {
+    lfb_population[page_list_lfb(bm_page)]--;
+
+    if (bm_page->next == bm_page) {
         // last page, make list empty
         *list = nullptr;
     } else {
@@ -548,17 +952,26 @@ static void delete_from_list(BmPageHeader* bm_page)
         bm_page->prev->next = bm_page->next;
     }
 
-#   ifdef DEBUG
-        bm_page->list = nullptr;
-#   endif
+    // mark page as grabbed
+    bm_page->list = nullptr;
 }
 
 static void grab_superblock_page(BmPageHeader* bm_page)
+/*
+ * Take bm_page out of superblock for exclusive use.
+ * If the page is grabbed by another thread, wait till it's returned.
+ */
 {
-    TRACE("taking page %p out of superblock[%u]\n", bm_page, bm_page->list - superblock);
-    mtx_lock(&lock);
+    lock_superblock();
+    while (!bm_page->list) {
+        page_waiters++;
+        cnd_wait(&page_returned, &lock);
+        page_waiters--;
+    }
+    TRACE("taking page %p out of superblock[%u]\n", bm_page, page_list_lfb(bm_page));
+    USDT_PROBE2(pussy, pet_page_grab, bm_page, page_list_lfb(bm_page));
     delete_from_list(bm_page);
-    mtx_unlock(&lock);
+    unlock_superblock();
 }
 
 static inline BmPageHeader* bm_page_from_addr(void* addr)
@@ -591,7 +1004,7 @@ static inline unsigned ptrdiff_to_units(void* addr, BmPageHeader* bm_page)
     }
 #endif
 
-static BmPageHeader* find_available_page(unsigned num_units)
+static BmPageHeader* find_available_page(PetLifetime lifetime, unsigned num_units)
 /*
  * Search superblock lists for a free page and if found, remove it from the list
  * so that the only thread can work with it and multiple threads can work with
@@ -600,69 +1013,565 @@ static BmPageHeader* find_available_page(unsigned num_units)
 {
     BmPageHeader* bm_page = nullptr;
 
-    mtx_lock(&lock);
+    lock_superblock();
 
     // start searching from num_units position
-    BmPageHeader** list = superblock + num_units;
+    BmPageHeader** list = superblocks[lifetime] + num_units;
     unsigned lfb = num_units;
     for (; lfb <= max_data_units; lfb++) {
         bm_page = *list++;
         if (bm_page) {
-            TRACE("taking page %p out of superblock[%u]\n", bm_page, bm_page->list - superblock);
+            TRACE("taking page %p out of superblock[%u]\n", bm_page, page_list_lfb(bm_page));
+            USDT_PROBE2(pussy, pet_page_grab, bm_page, lfb);
             delete_from_list(bm_page);
             break;
         }
     }
-    mtx_unlock(&lock);
+    unlock_superblock();
     return bm_page;
 }
 
-static void* bm_allocate(unsigned num_units, bool clean)
-/*
+/****************************************************************
+ * Cache of empty bitmap pages
+ *
+ * Pages that become empty are kept mapped, up to pet_tunables.page_cache_size,
+ * and reused for new bitmap pages, the most recently released first.
+ * Pages that stay in the cache longer than pet_tunables.page_decay_time
+ * are unmapped when other pages are released.
+ */
+
+#define MAX_DECAYED_PAGES  16  // unmapped per release, the rest will be unmapped later
+
+typedef struct {
+    BmPageHeader* page;
+    double expires;
+} CachedPage;
+
+static CachedPage* page_cache = nullptr;  // ring, oldest page at page_cache_tail
+static unsigned page_cache_capacity = 0;
+static unsigned page_cache_tail = 0;
+
+static inline double monotonic_time()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void init_page_cache()
+{
+    if (pet_tunables.page_cache_size == 0) {
+        return;
+    }
+    page_cache = call_mmap(align_unsigned_to_page(pet_tunables.page_cache_size * sizeof(CachedPage)), false);
+    if (page_cache) {
+        page_cache_capacity = pet_tunables.page_cache_size;
+    }
+}
+
+static void cache_page(BmPageHeader* bm_page)
+/*
+ * Put empty page to the cache or unmap it if caching is disabled.
+ */
+{
+    USDT_PROBE1(pussy, pet_page_empty, bm_page);
+    if (page_cache_capacity == 0) {
+        call_munmap(bm_page, sys_page_size);
+        return;
+    }
+    BmPageHeader* unmap[MAX_DECAYED_PAGES + 1];
+    unsigned num_unmap = 0;
+    double now = (pet_tunables.page_decay_time > 0)? monotonic_time() : 0;
+
+    lock_superblock();
+    while (num_cached_pages && num_unmap < MAX_DECAYED_PAGES
+           && now && page_cache[page_cache_tail].expires <= now) {
+        unmap[num_unmap++] = page_cache[page_cache_tail].page;
+        page_cache_tail = (page_cache_tail + 1) % page_cache_capacity;
+        num_cached_pages--;
+    }
+    if (num_cached_pages == page_cache_capacity) {
+        // evict the oldest one
+        unmap[num_unmap++] = page_cache[page_cache_tail].page;
+        page_cache_tail = (page_cache_tail + 1) % page_cache_capacity;
+        num_cached_pages--;
+    }
+    CachedPage* entry = &page_cache[(page_cache_tail + num_cached_pages) % page_cache_capacity];
+    entry->page = bm_page;
+    entry->expires = now + pet_tunables.page_decay_time;
+    num_cached_pages++;
+    unlock_superblock();
+
+    for (unsigned i = 0; i < num_unmap; i++) {
+        call_munmap(unmap[i], sys_page_size);
+    }
+}
+
+static BmPageHeader* uncache_page(unsigned* num_left)
+/*
+ * Take the most recently cached page. Return the number of pages left in the cache in `num_left`.
+ */
+{
+    *num_left = 0;
+    if (page_cache_capacity == 0) {
+        return nullptr;
+    }
+    BmPageHeader* bm_page = nullptr;
+    lock_superblock();
+    if (num_cached_pages) {
+        num_cached_pages--;
+        bm_page = page_cache[(page_cache_tail + num_cached_pages) % page_cache_capacity].page;
+    }
+    *num_left = num_cached_pages;
+    unlock_superblock();
+    return bm_page;
+}
+
+/****************************************************************
+ * Page provisioner
+ *
+ * Optional background thread that keeps the page cache filled ahead of demand,
+ * so that bursts of allocations take ready pages instead of calling mmap inline.
+ *
+ * While pages are being taken, the thread checks the cache every PROVISION_INTERVAL.
+ * When idle, it sleeps until a page is taken again.
+ * The thread is stopped at exit or with pet_stop_provisioner.
+ * It fills the cache up to the low watermark plus twice the number of pages
+ * expected to be taken till the next check, judging by the rate since the previous one.
+ * Pages are mapped in batches with MAP_POPULATE, so they are prefaulted.
+ * Provisioned pages decay as other cached pages do.
+ */
+
+#define PROVISION_INTERVAL  0.1  // seconds
+#define PROVISION_BATCH     64   // pages mapped at once
+
+static atomic_bool provisioner_running = false;
+static atomic_bool stop_provisioner = false;
+static thrd_t provisioner_thread;
+static unsigned provision_watermark = 0;
+static Event provision_event;  // never finalized, page_taken may set it after the thread is stopped
+static atomic_bool provision_requested = false;
+static atomic_bool provisioner_idle = false;
+static atomic_size_t pages_taken = 0;  // for new bitmap pages since the last check
+
+static void provision_pages(unsigned num_pages)
+{
+    while (num_pages && !atomic_load(&stop_provisioner)) {
+        unsigned n = (num_pages < PROVISION_BATCH)? num_pages : PROVISION_BATCH;
+        unsigned size = n * sys_page_size;
+        uint8_t* pages = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (pages == MAP_FAILED) {
+            ERR("mmap: %s\n", strerror(errno));
+            return;
+        }
+        USDT_PROBE2(pussy, pet_mmap, pages, size);
+        double expires = (pet_tunables.page_decay_time > 0)? monotonic_time() + pet_tunables.page_decay_time : 0;
+
+        lock_superblock();
+        unsigned i = 0;
+        for (; i < n && num_cached_pages < page_cache_capacity; i++) {
+            CachedPage* entry = &page_cache[(page_cache_tail + num_cached_pages) % page_cache_capacity];
+            entry->page = (BmPageHeader*) (pages + i * sys_page_size);
+            entry->expires = expires;
+            num_cached_pages++;
+        }
+        unlock_superblock();
+
+        if (i < n) {
+            // the cache was filled with released pages meanwhile
+            call_munmap(pages + i * sys_page_size, (n - i) * sys_page_size);
+            return;
+        }
+        num_pages -= n;
+    }
+}
+
+static int provisioner(void* arg)
+{
+    double last_check = monotonic_time();
+    double timeout = PROVISION_INTERVAL;
+    for (;;) {
+        wait_event(&provision_event, timeout);
+        if (atomic_load(&stop_provisioner)) {
+            break;
+        }
+        clear_event(&provision_event);
+        atomic_store(&provision_requested, false);
+
+        double now = monotonic_time();
+        double elapsed = now - last_check;
+        last_check = now;
+        size_t taken = atomic_exchange(&pages_taken, 0);
+        // keep checking while pages are taken, sleep till the next one when idle
+        timeout = taken? PROVISION_INTERVAL : -1;
+        atomic_store(&provisioner_idle, !taken);
+        double rate = taken / ((elapsed > 0.001)? elapsed : 0.001);
+
+        double target = provision_watermark + 2 * rate * PROVISION_INTERVAL;
+        if (target > page_cache_capacity) {
+            target = page_cache_capacity;
+        }
+        lock_superblock();
+        unsigned num_cached = num_cached_pages;
+        unlock_superblock();
+        if (num_cached < (unsigned) target) {
+            TRACE("provisioning %u pages, %zu pages taken in %g s\n", (unsigned) target - num_cached, taken, elapsed);
+            USDT_PROBE1(pussy, pet_provision, (unsigned) target - num_cached);
+            provision_pages((unsigned) target - num_cached);
+        }
+    }
+    return 0;
+}
+
+static void start_provisioner()
+{
+    if (!pet_tunables.provision_pages) {
+        return;
+    }
+    if (page_cache_capacity == 0) {
+        ERR("page provisioner requires page cache\n");
+        return;
+    }
+    provision_watermark = (page_cache_capacity + 3) / 4;
+    if (!init_event(&provision_event)) {
+        ERR("cannot create event: %s\n", strerror(errno));
+        return;
+    }
+    if (thrd_create(&provisioner_thread, provisioner, nullptr) != thrd_success) {
+        ERR("cannot start page provisioner\n");
+        fini_event(&provision_event);
+        return;
+    }
+    atomic_store(&provisioner_running, true);
+    atexit(pet_stop_provisioner);
+}
+
+void pet_stop_provisioner()
+{
+    if (!atomic_exchange(&provisioner_running, false)) {
+        return;
+    }
+    atomic_store(&stop_provisioner, true);
+    set_event(&provision_event);
+    thrd_join(provisioner_thread, nullptr);
+}
+
+static inline void page_taken(unsigned num_cached)
+/*
+ * Count pages taken for new bitmap pages and wake up the provisioner
+ * if it is idle or the cache runs low.
+ */
+{
+    if (!atomic_load_explicit(&provisioner_running, memory_order_relaxed)) {
+        return;
+    }
+    atomic_fetch_add_explicit(&pages_taken, 1, memory_order_relaxed);
+    bool wake = atomic_load_explicit(&provisioner_idle, memory_order_relaxed)
+                || num_cached < provision_watermark;
+    if (wake && !atomic_exchange(&provision_requested, true)) {
+        set_event(&provision_event);
+    }
+}
+
+static BmPageHeader* new_bm_page(PetLifetime lifetime, unsigned num_units)
+/*
+ * Take a page from the cache or map a new one and allocate
+ * the first block of `num_units` in it.
+ * The page is not added to the superblock.
+ */
+{
+    TRACE("allocating new page\n");
+
+    unsigned num_cached;
+    BmPageHeader* bm_page = uncache_page(&num_cached);
+    bool cached = bm_page;
+    page_taken(num_cached);
+    if (!bm_page) {
+        bm_page = call_mmap(sys_page_size, false);
+        if (!bm_page) {
+            return nullptr;
+        }
+    }
+    USDT_PROBE3(pussy, pet_page_new, bm_page, lifetime, cached);
+    // clean bitmap
+    Word* ptr = bm_page->bitmap;
+    for (unsigned i = 0, n = bitmap_words(); i < n; i++) {
+        *ptr++ = 0;
+    }
+    // mark reserved units and allocate units
+    set_bits(bm_page, 0, bm_page_header_size_in_units + num_units);
+    bm_page->cursor = bm_page_header_size_in_units + num_units;
+    bm_page->lifetime = lifetime;
+    bm_page->users = 0;
+    bm_page->num_blocks = 1;
+
+    atomic_fetch_add(&num_bm_pages, 1);
+    atomic_fetch_add(&lifetime_pages[lifetime], 1);
+    return bm_page;
+}
+
+/****************************************************************
+ * Concurrent pages
+ *
+ * In concurrent mode bitmap words are updated with atomic operations,
+ * so that pages need not be grabbed to release, shrink, or grow blocks.
+ *
+ * Blocks that fit in a single bitmap word are allocated from hot pages,
+ * one per block size. Threads claim bits in a hot page with compare-and-swap
+ * and do not take the lock. Hot pages are out of the superblock.
+ * When a hot page has no room for its block size it's returned to the superblock
+ * and the thread that failed to allocate takes another one.
+ * Larger blocks are allocated from grabbed pages as usual.
+ *
+ * Pages are re-bucketed lazily: a release moves the page to an upper list
+ * only if the released block is longer than the list says. Lists may
+ * also overestimate free space because of allocations from former hot pages.
+ * Allocations that find less free space than expected put the page to
+ * its actual list and try the next one.
+ *
+ * A thread may still hold a pointer to a page after the page has left
+ * its hot slot, so empty pages are reclaimed only when the page is in
+ * the superblock, no thread is between loading a hot slot and incrementing
+ * page users, and the page has no users except the releasing thread.
+ * Otherwise the page stays in the superblock and will be reused.
+ */
+
+static bool hot_slots_have_readers()
+{
+    HotSlot* slot = &hot_slots[0][0];
+    for (unsigned i = 0; i < PET_NUM_LIFETIMES * HOT_MAX_UNITS; i++, slot++) {
+        if (atomic_load(&slot->readers)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void rebucket_page(BmPageHeader* bm_page, unsigned min_lfb)
+/*
+ * Move page to the upper list if its longest free block is at least min_lfb.
+ * The caller should be a user of the page.
+ */
+{
+    BmPageHeader** list = atomic_load_explicit((_Atomic(BmPageHeader**)*) &bm_page->list, memory_order_relaxed);
+    if (!list || (unsigned) (list - page_superblock(bm_page)) >= min_lfb) {
+        return;
+    }
+    lock_superblock();
+    if (bm_page->list) {
+        unsigned lfb = find_longest_free_block(bm_page);
+        if (lfb > page_list_lfb(bm_page)) {
+            delete_from_list(bm_page);
+            link_to_superblock_entry(bm_page, lfb);
+        }
+    }
+    unlock_superblock();
+}
+
+static void drop_page_user(BmPageHeader* bm_page)
+/*
+ * Drop the reference of the current thread and unmap or cache the page if it's empty
+ * and this was the last reference. Empty pages that are grabbed or hot are not reclaimed,
+ * return_page takes care of them.
+ */
+{
+    if (atomic_load(&bm_page->num_blocks)) {
+        atomic_fetch_sub(&bm_page->users, 1);
+        return;
+    }
+    // readers leave the window in a few instructions unless they are preempted
+    for (unsigned i = 0; i < MAX_RECLAIM_YIELDS && hot_slots_have_readers(); i++) {
+        thrd_yield();
+    }
+    lock_superblock();
+    // the order matters: hot allocation increments num_blocks before dropping its users reference
+    bool reclaim = bm_page->list && !hot_slots_have_readers()
+                   && atomic_load(&bm_page->users) == 1 && atomic_load(&bm_page->num_blocks) == 0;
+    if (reclaim) {
+        delete_from_list(bm_page);
+    } else {
+        // under the lock, so that the last user sees itself as the only one
+        atomic_fetch_sub(&bm_page->users, 1);
+    }
+    unlock_superblock();
+
+    if (reclaim) {
+        TRACE("releasing page %p\n", bm_page);
+        atomic_fetch_sub(&lifetime_pages[bm_page->lifetime], 1);
+        cache_page(bm_page);
+        atomic_fetch_sub(&num_bm_pages, 1);
+    }
+}
+
+static void return_page(BmPageHeader* bm_page)
+/*
+ * Return grabbed or hot page to the superblock.
+ * If its last block was released meanwhile, nobody else would reclaim it.
+ */
+{
+    atomic_fetch_add(&bm_page->users, 1);
+    add_to_superblock(bm_page);
+    drop_page_user(bm_page);
+}
+
+static BmPageHeader* cc_take_page(PetLifetime lifetime, unsigned num_units, unsigned* offset)
+/*
+ * Grab a page from the superblock and allocate a block in it,
+ * or allocate the block in a new page.
+ * The page is not returned to the superblock.
+ */
+{
+    BmPageHeader* bm_page;
+    while ((bm_page = find_available_page(lifetime, num_units))) {
+        unsigned result;
+        while ((result = find_free_block(bm_page, num_units))) {
+            if (claim_bits(bm_page, result, num_units)) {
+                atomic_fetch_add(&bm_page->num_blocks, 1);
+                bm_page->cursor = result + num_units;
+                *offset = result;
+                return bm_page;
+            }
+            // bits were claimed by a thread that holds the page as hot, try again
+        }
+        TRACE("bm_page %p has less free space than its list says\n", bm_page);
+        return_page(bm_page);
+    }
+    bm_page = new_bm_page(lifetime, num_units);
+    *offset = bm_page_header_size_in_units;
+    return bm_page;
+}
+
+static void* cc_allocate(PetLifetime lifetime, unsigned num_units)
+{
+    unsigned offset;
+    BmPageHeader* bm_page;
+
+    if (num_units > HOT_MAX_UNITS) {
+        bm_page = cc_take_page(lifetime, num_units, &offset);
+        if (!bm_page) {
+            return nullptr;
+        }
+        add_to_superblock(bm_page);
+        return ((uint8_t*) bm_page) + offset * UNIT_SIZE;
+    }
+
+    HotSlot* slot = &hot_slots[lifetime][num_units - 1];
+    for (;;) {
+        atomic_fetch_add(&slot->readers, 1);
+        bm_page = atomic_load(&slot->page);
+        if (bm_page) {
+            atomic_fetch_add(&bm_page->users, 1);
+        }
+        atomic_fetch_sub(&slot->readers, 1);
+        if (!bm_page) {
+            break;
+        }
+        offset = claim_bits_in_word(bm_page, num_units);
+        if (offset) {
+            atomic_fetch_add(&bm_page->num_blocks, 1);
+        }
+        atomic_fetch_sub(&bm_page->users, 1);
+        if (offset) {
+            return ((uint8_t*) bm_page) + offset * UNIT_SIZE;
+        }
+        // no room for num_units, whoever takes the page out of the slot returns it to the superblock
+        if (atomic_compare_exchange_strong(&slot->page, &bm_page, nullptr)) {
+            TRACE("hot page %p is full for %u units\n", bm_page, num_units);
+            return_page(bm_page);
+        }
+    }
+
+    // install new hot page
+    bm_page = cc_take_page(lifetime, num_units, &offset);
+    if (!bm_page) {
+        return nullptr;
+    }
+    BmPageHeader* expected = nullptr;
+    if (!atomic_compare_exchange_strong(&slot->page, &expected, bm_page)) {
+        // another thread was faster
+        add_to_superblock(bm_page);
+    }
+    return ((uint8_t*) bm_page) + offset * UNIT_SIZE;
+}
+
+static void cc_release(BmPageHeader* bm_page, unsigned offset, unsigned num_units)
+{
+    // the page cannot be reclaimed while we own the block, hold it for the rest
+    atomic_fetch_add(&bm_page->users, 1);
+
+#   ifdef DEBUG
+        check_units_allocated(__func__, bm_page, offset, num_units);
+#   endif
+    atomic_clear_bits(bm_page, offset, num_units);
+
+    if (atomic_fetch_sub(&bm_page->num_blocks, 1) > 1) {
+        rebucket_page(bm_page, num_units);
+    }
+    drop_page_user(bm_page);
+}
+
+static void cc_shrink(BmPageHeader* bm_page, unsigned offset, unsigned old_num_units, unsigned new_num_units)
+{
+    unsigned tail_units = old_num_units - new_num_units;
+
+#   ifdef DEBUG
+        check_units_allocated(__func__, bm_page, offset + new_num_units, tail_units);
+#   endif
+    atomic_clear_bits(bm_page, offset + new_num_units, tail_units);
+
+    rebucket_page(bm_page, tail_units);
+}
+
+static bool cc_grow(BmPageHeader* bm_page, unsigned offset, unsigned old_num_units, unsigned new_num_units)
+{
+    if (offset + new_num_units > units_per_page) {
+        return false;
+    }
+    return claim_bits(bm_page, offset + old_num_units, new_num_units - old_num_units);
+}
+
+static void* bm_allocate(PetLifetime lifetime, unsigned num_units, bool clean)
+/*
  * Bitmap sub-allocator, should be called with num_units < max_data_units
  */
 {
     TRACE("num_units %u\n", num_units);
 
     void* result = nullptr;
-    BmPageHeader* bm_page = find_available_page(num_units);
+    if (concurrent_pages) {
+        result = cc_allocate(lifetime, num_units);
+        goto out;
+    }
+    BmPageHeader* bm_page = find_available_page(lifetime, num_units);
     if (bm_page) {
         // allocate
         unsigned offset = find_free_block(bm_page, num_units);
         if (offset == 0) {
             ERR("bm_page %p with LFB=%u must contain enough free space for %u units\n",
-                bm_page, bm_page->list - superblock, num_units);
-            abort();
+                bm_page, page_list_lfb(bm_page), num_units);
+            log_flush_and_abort();
         }
         set_bits(bm_page, offset, num_units);
+        bm_page->cursor = offset + num_units;
         add_to_superblock(bm_page);
         result = ((uint8_t*) bm_page) + offset * UNIT_SIZE;
         goto out;
     }
 
-    TRACE("allocating new page\n");
-
-    bm_page = call_mmap(sys_page_size, false);
+    bm_page = new_bm_page(lifetime, num_units);
     if (!bm_page) {
         goto out;
     }
-    // clean bitmap
-    Word* ptr = bm_page->bitmap;
-    for (unsigned i = 0, n = units_per_page / WORD_WIDTH; i < n; i++) {
-        *ptr++ = 0;
-    }
-    // mark reserved units and allocate units
-    set_bits(bm_page, 0, bm_page_header_size_in_units + num_units);
-
     // add page to the superblock
     add_to_superblock_entry(bm_page, max_data_units - num_units);
 
-    atomic_fetch_add(&num_bm_pages, 1);
     result = ((uint8_t*) bm_page) + bm_page_header_size_in_units * UNIT_SIZE;
 
 out:
     if (result) {
         atomic_fetch_add(&stats.blocks_allocated, 1);
+        atomic_fetch_add(&lifetime_units[lifetime], num_units);
     }
 
     if (result && clean) {
@@ -677,6 +1586,12 @@ static void bm_shrink(BmPageHeader* bm_page, unsigned offset, unsigned old_num_u
     TRACE("bm_page=%p, offset=%u, old_num_units=%u, new_num_units=%u\n",
           bm_page, offset, old_num_units, new_num_units);
 
+    atomic_fetch_sub(&lifetime_units[bm_page->lifetime], old_num_units - new_num_units);
+
+    if (concurrent_pages) {
+        cc_shrink(bm_page, offset, old_num_units, new_num_units);
+        return;
+    }
     grab_superblock_page(bm_page);
 
     unsigned tail_units = old_num_units - new_num_units;
@@ -694,17 +1609,24 @@ static bool bm_grow(BmPageHeader* bm_page, unsigned offset, unsigned old_num_uni
     TRACE("bm_page=%p, offset=%u, old_num_units=%u, new_num_units=%u\n",
           bm_page, offset, old_num_units, new_num_units);
 
-    grab_superblock_page(bm_page);
-
     unsigned increment = new_num_units - old_num_units;
-    unsigned length = count_zero_bits(bm_page, offset + old_num_units, increment);
-    if (length < increment) {
-        mtx_unlock(&lock);
-        return false;
-    }
-    set_bits(bm_page, offset + old_num_units, increment);
+    if (concurrent_pages) {
+        if (!cc_grow(bm_page, offset, old_num_units, new_num_units)) {
+            return false;
+        }
+    } else {
+        grab_superblock_page(bm_page);
 
-    add_to_superblock(bm_page);
+        unsigned length = count_zero_bits(bm_page, offset + old_num_units, increment);
+        if (length < increment) {
+            add_to_superblock(bm_page);
+            return false;
+        }
+        set_bits(bm_page, offset + old_num_units, increment);
+
+        add_to_superblock(bm_page);
+    }
+    atomic_fetch_add(&lifetime_units[bm_page->lifetime], increment);
     return true;
 }
 
@@ -712,6 +1634,13 @@ static void bm_release(BmPageHeader* bm_page, unsigned offset, unsigned num_unit
 {
     TRACE("bm_page=%p, offset=%u, num_units=%u\n", bm_page, offset, num_units);
 
+    atomic_fetch_sub(&lifetime_units[bm_page->lifetime], num_units);
+
+    if (concurrent_pages) {
+        cc_release(bm_page, offset, num_units);
+        atomic_fetch_sub(&stats.blocks_allocated, 1);
+        return;
+    }
     grab_superblock_page(bm_page);
 
 #   ifdef DEBUG
@@ -724,7 +1653,8 @@ static void bm_release(BmPageHeader* bm_page, unsigned offset, unsigned num_unit
         add_to_superblock_entry(bm_page, lfb);
     } else {
         TRACE("releasing page %p\n", bm_page);
-        call_munmap(bm_page, sys_page_size);
+        atomic_fetch_sub(&lifetime_pages[bm_page->lifetime], 1);
+        cache_page(bm_page);
         atomic_fetch_sub(&num_bm_pages, 1);
     }
     atomic_fetch_sub(&stats.blocks_allocated, 1);
@@ -748,26 +1678,53 @@ static void _init()
 
     max_data_units = units_per_page - bm_page_header_size_in_units;
 
+#   ifdef PET_PAGE_SIZE
+        fixed_geometry = sys_page_size == PET_PAGE_SIZE;
+        if (!fixed_geometry) {
+            SAY("page size %u differs from build-time %u, using runtime geometry\n", sys_page_size, PET_PAGE_SIZE);
+        }
+#   endif
+
     // allocate superblock
 
-    superblock = call_mmap(sys_page_size, true);
+    BmPageHeader** superblock = call_mmap(
+        align_unsigned_to_page(PET_NUM_LIFETIMES * units_per_page * sizeof(BmPageHeader*)), true
+    );
     if (!superblock) {
-        abort();
+        log_flush_and_abort();
+    }
+    for (unsigned i = 0; i < PET_NUM_LIFETIMES; i++) {
+        superblocks[i] = superblock + i * units_per_page;
     }
+    lfb_population = call_mmap(align_unsigned_to_page(units_per_page * sizeof(unsigned)), true);
+    if (!lfb_population) {
+        log_flush_and_abort();
+    }
+    init_page_cache();
+    concurrent_pages = pet_tunables.concurrent_pages;
 
     // init mutex
     if (mtx_init(&lock, mtx_plain) != thrd_success) {
         ERR("cannot init mutex\n");
     }
+    if (cnd_init(&page_returned) != thrd_success) {
+        ERR("cannot init condition variable\n");
+    }
+    // the provisioner takes the lock
+    start_provisioner();
 
     SAY("page size %u; units per page: %u; header: %u units; data units: %u (%u bytes)\n",
         sys_page_size, units_per_page, bm_page_header_size_in_units, max_data_units, max_data_units * UNIT_SIZE);
+    SAY("page cache: %u pages, decay time %g s; huge pages: %s\n",
+        page_cache_capacity, pet_tunables.page_decay_time, pet_tunables.huge_pages? "yes" : "no");
+    SAY("concurrent pages: %s\n", concurrent_pages? "yes" : "no");
+    SAY("page provisioner: %s\n", provisioner_running? "yes" : "no");
 }
 
 
-static void* _allocate(unsigned nbytes, bool clean)
+static void* allocate_with_lifetime(unsigned nbytes, bool clean, PetLifetime lifetime)
 {
-    TRACE("nbytes=%u\n", nbytes);
+    TRACE("nbytes=%u lifetime=%u\n", nbytes, lifetime);
 
     if (nbytes == 0) {
         return nullptr;
@@ -775,17 +1732,54 @@ static void* _allocate(unsigned nbytes, bool clean)
     unsigned num_units = bytes_to_units(nbytes);
     if (num_units < max_data_units) {
         // use bitmap sub-allocator for smaller blocks
-        return bm_allocate(num_units, clean);
+        return bm_allocate(lifetime, num_units, clean);
     } else {
         // allocate pages directly
-        void* result = call_mmap(align_unsigned_to_page(nbytes), clean);
+        unsigned size = align_unsigned_to_page(nbytes);
+        void* result = call_mmap(size, clean);
         if (result) {
             atomic_fetch_add(&stats.blocks_allocated, 1);
+            atomic_fetch_add(&num_large_blocks, 1);
+            atomic_fetch_add(&large_mapped_bytes, size);
         }
         return result;
     }
 }
 
+static void* _allocate(unsigned nbytes, bool clean)
+{
+    if (stats.size_profile) {
+        size_profile_record(stats.size_profile, nbytes);
+    }
+    return allocate_with_lifetime(nbytes, clean, lifetime_hint);
+}
+
+void* pet_allocate_with_lifetime(unsigned nbytes, bool clean, PetLifetime lifetime)
+{
+    if (stats.size_profile) {
+        size_profile_record(stats.size_profile, nbytes);
+    }
+    return allocate_with_lifetime(nbytes, clean, lifetime);
+}
+
+PetLifetime pet_set_lifetime(PetLifetime lifetime)
+{
+    PetLifetime previous = lifetime_hint;
+    lifetime_hint = lifetime;
+    return previous;
+}
+
+void pet_get_geometry(PetGeometry* geometry)
+{
+    // calculated the same way as in _init, because pet_allocator may be not initialized
+    unsigned units = sys_page_size / UNIT_SIZE;
+    unsigned header_units = (offsetof(BmPageHeader, bitmap) + units / 8 + UNIT_SIZE - 1) / UNIT_SIZE;
+    geometry->page_size = sys_page_size;
+    geometry->unit_size = UNIT_SIZE;
+    geometry->bitmap_offset = offsetof(BmPageHeader, bitmap);
+    geometry->max_bitmap_block = (units - header_units - 1) * UNIT_SIZE;
+}
+
 static void _release(void** addr_ptr, unsigned nbytes)
 {
     void* addr = *addr_ptr;
@@ -797,7 +1791,7 @@ static void _release(void** addr_ptr, unsigned nbytes)
 
     if (nbytes == 0) {
         ERR("called for %p with zero nbytes\n", addr);
-        abort();
+        log_flush_and_abort();
     }
 
     BmPageHeader* bm_page = bm_page_from_addr(addr);
@@ -806,8 +1800,11 @@ static void _release(void** addr_ptr, unsigned nbytes)
          * addr is aligned on page boundary, this means
          * the block was allocated directly with mmap
          */
-        call_munmap(addr, align_unsigned_to_page(nbytes));
+        unsigned size = align_unsigned_to_page(nbytes);
+        call_munmap(addr, size);
         atomic_fetch_sub(&stats.blocks_allocated, 1);
+        atomic_fetch_sub(&num_large_blocks, 1);
+        atomic_fetch_sub(&large_mapped_bytes, size);
 
     } else {
         // use bitmap sub-allocator for smaller blocks
@@ -826,12 +1823,16 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
 
     TRACE("addr=%p old_nbytes=%u new_nbytes=%u\n", addr, old_nbytes, new_nbytes);
 
+    if (stats.size_profile) {
+        size_profile_record(stats.size_profile, new_nbytes);
+    }
+
     // shall we allocate new addr?
     if (addr == nullptr) {
         if (old_nbytes != 0) {
             goto error;
         }
-        addr = _allocate(new_nbytes, clean);
+        addr = allocate_with_lifetime(new_nbytes, clean, lifetime_hint);
         if (!addr) {
             goto error;
         }
@@ -869,7 +1870,7 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
                 // shrink using bitmap sub-allocator
                 if (addr == (void*) bm_page) {
                     ERR("address %p is not within data area\n", addr);
-                    abort();
+                    log_flush_and_abort();
                 }
                 bm_shrink(bm_page, ptrdiff_to_units(addr, bm_page), old_num_units, new_num_units);
                 goto success_same_addr;
@@ -879,15 +1880,19 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
 
             if (addr != (void*) bm_page) {
                 ERR("address %p is not aligned on page boundary\n", addr);
-                abort();
+                log_flush_and_abort();
             }
-            void* new_block = bm_allocate(new_num_units, false);
+            void* new_block = bm_allocate(lifetime_hint, new_num_units, false);
             if (!new_block) {
                 TRACE("falling back to remap\n");
                 goto remap;
             }
             memcpy(new_block, addr, new_nbytes);
-            bm_release(bm_page, ptrdiff_to_units(addr, bm_page), new_num_units);
+            unsigned old_size = align_unsigned_to_page(old_nbytes);
+            call_munmap(addr, old_size);
+            atomic_fetch_sub(&stats.blocks_allocated, 1);
+            atomic_fetch_sub(&num_large_blocks, 1);
+            atomic_fetch_sub(&large_mapped_bytes, old_size);
             *addr_ptr = new_block;
             goto success_changed_addr;
 
@@ -895,7 +1900,7 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
             // shrink using mremap
             if (addr != (void*) bm_page) {
                 ERR("address %p is not aligned on page boundary\n", addr);
-                abort();
+                log_flush_and_abort();
             }
     remap:
             call_mremap(addr, old_nbytes, new_nbytes, false);
@@ -913,7 +1918,7 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
 
             if (addr == (void*) bm_page) {
                 ERR("address %p is not within data area\n", addr);
-                abort();
+                log_flush_and_abort();
             }
             // try to grow within the same page
             if(bm_grow(bm_page, ptrdiff_to_units(addr, bm_page), old_num_units, new_num_units)) {
@@ -922,11 +1927,12 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
                 }
                 goto success_same_addr;
             }
+            USDT_PROBE3(pussy, pet_grow_fail, addr, old_nbytes, new_nbytes);
         }
 
-        // reallocate block
+        // reallocate block, keeping its lifetime
 
-        void* new_block = _allocate(new_nbytes, false);
+        void* new_block = allocate_with_lifetime(new_nbytes, false, bm_page->lifetime);
         if (!new_block) {
             goto error;
         }
@@ -943,7 +1949,7 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
         // grow using mremap
         if (addr != (void*) bm_page) {
             ERR("address %p is not aligned on page boundary\n", addr);
-            abort();
+            log_flush_and_abort();
         }
         void* new_addr = call_mremap(addr, old_nbytes, new_nbytes, clean);
         if (!new_addr) {
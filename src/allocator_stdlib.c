@@ -3,11 +3,27 @@
 #include "string.h"
 
 #include "allocator.h"
+#include "size_profile.h"
+#include "usdt.h"
 
 static AllocatorStats stats = {};
 
+/*
+ * USDT probes, see usdt.h:
+ *
+ *   stdlib_allocate  addr or 0 if failed, nbytes
+ *   stdlib_release   addr, nbytes
+ *   stdlib_realloc   addr, old nbytes, new nbytes, before calling realloc
+ */
+USDT_SEMAPHORE(pussy, stdlib_allocate);
+USDT_SEMAPHORE(pussy, stdlib_release);
+USDT_SEMAPHORE(pussy, stdlib_realloc);
+
 static void* _allocate(unsigned nbytes, bool clean)
 {
+    if (stats.size_profile) {
+        size_profile_record(stats.size_profile, nbytes);
+    }
     void* result;
     if (clean) {
         result = calloc(1, nbytes);
@@ -17,6 +33,7 @@ static void* _allocate(unsigned nbytes, bool clean)
     if (result) {
         atomic_fetch_add(&stats.blocks_allocated, 1);
     }
+    USDT_PROBE2(pussy, stdlib_allocate, result, nbytes);
     return result;
 }
 
@@ -24,6 +41,7 @@ static void _release(void** addr_ptr, unsigned nbytes)
 {
     void* addr = *addr_ptr;
     if (addr) {
+        USDT_PROBE2(pussy, stdlib_release, addr, nbytes);
         free(addr);
         *addr_ptr = nullptr;
         atomic_fetch_sub(&stats.blocks_allocated, 1);
@@ -51,6 +69,10 @@ static bool _reallocate(void** addr_ptr, unsigned old_nbytes, unsigned new_nbyte
         goto success_changed_addr;
     }
 
+    if (stats.size_profile) {
+        size_profile_record(stats.size_profile, new_nbytes);
+    }
+    USDT_PROBE3(pussy, stdlib_realloc, addr, old_nbytes, new_nbytes);
     void* new_block = realloc(addr, new_nbytes);
     if (!new_block) {
         goto error;
@@ -0,0 +1,284 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "async_log.h"
+
+#define LOG_BUFFER_SIZE    (64 * 1024)  // per thread, power of two
+#define MAX_MESSAGE_SIZE   1024
+#define FLUSH_INTERVAL_NS  10'000'000
+
+typedef struct _LogBuffer LogBuffer;
+
+struct _LogBuffer {
+    LogBuffer* next;         // in the list of all buffers, buffers are never freed
+    atomic_bool owned;       // by a live thread, buffers of exited threads are reused
+    atomic_size_t dropped;   // messages that did not fit
+    // free running counters, head is advanced by the owner, tail by the flusher
+    _Alignas(64) atomic_size_t head;
+    _Alignas(64) atomic_size_t tail;
+    uint8_t data[LOG_BUFFER_SIZE];
+};
+
+static int log_fd = 2;
+
+static once_flag start_once = ONCE_FLAG_INIT;
+static atomic_bool running = false;    // flusher is running, writers use buffers
+static atomic_bool stopping = false;
+static thrd_t flusher_thread;
+static tss_t buffer_key;               // to release the buffer when thread exits
+static mtx_t drain_lock;               // serializes readers of buffers
+
+static _Atomic(LogBuffer*) buffers = nullptr;
+static thread_local LogBuffer* thread_buffer = nullptr;
+
+static atomic_size_t total_dropped = 0;
+static size_t reported_dropped = 0;    // updated under drain_lock
+
+static void write_all(uint8_t* data, size_t size)
+/*
+ * Write to log ignoring errors, there's nowhere to report them.
+ */
+{
+    while (size) {
+        ssize_t n = write(log_fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+/****************************************************************
+ * Flusher
+ */
+
+static void drain()
+/*
+ * Write out contents of all buffers and report dropped messages.
+ */
+{
+    mtx_lock(&drain_lock);
+    for (LogBuffer* buf = atomic_load(&buffers); buf; buf = buf->next) {
+        size_t tail = atomic_load_explicit(&buf->tail, memory_order_relaxed);
+        size_t head = atomic_load_explicit(&buf->head, memory_order_acquire);
+        while (tail != head) {
+            size_t offset = tail & (LOG_BUFFER_SIZE - 1);
+            size_t size = head - tail;
+            if (size > LOG_BUFFER_SIZE - offset) {
+                size = LOG_BUFFER_SIZE - offset;
+            }
+            write_all(buf->data + offset, size);
+            tail += size;
+        }
+        atomic_store_explicit(&buf->tail, tail, memory_order_release);
+
+        size_t dropped = atomic_exchange(&buf->dropped, 0);
+        if (dropped) {
+            atomic_fetch_add(&total_dropped, dropped);
+        }
+    }
+    size_t dropped = atomic_load(&total_dropped);
+    if (dropped != reported_dropped) {
+        char msg[80];
+        int n = snprintf(msg, sizeof(msg), "libpussy: %zu log messages dropped\n", dropped - reported_dropped);
+        write_all((uint8_t*) msg, n);
+        reported_dropped = dropped;
+    }
+    mtx_unlock(&drain_lock);
+}
+
+static int flusher(void* arg)
+{
+    struct timespec interval = { .tv_sec = 0, .tv_nsec = FLUSH_INTERVAL_NS };
+    while (!atomic_load(&stopping)) {
+        drain();
+        thrd_sleep(&interval, nullptr);
+    }
+    drain();
+    return 0;
+}
+
+static void stop_logger()
+/*
+ * Called at exit. Messages logged after that are written synchronously.
+ * In a forked child this does nothing.
+ */
+{
+    if (!atomic_load(&running)) {
+        return;
+    }
+    atomic_store(&stopping, true);
+    thrd_join(flusher_thread, nullptr);
+    atomic_store(&running, false);
+    // catch messages written while the flusher was stopping
+    drain();
+}
+
+static void release_buffer(void* buf)
+/*
+ * Thread exit handler.
+ */
+{
+    atomic_store(&((LogBuffer*) buf)->owned, false);
+}
+
+static void reset_logger_in_child()
+/*
+ * Fork handler. The child has no flusher thread, so messages are written synchronously
+ * and stop_logger has nothing to join.
+ * Messages left in buffers are the parent's, the parent writes them.
+ */
+{
+    atomic_store(&running, false);
+    atomic_store(&stopping, false);
+}
+
+static void start_logger()
+{
+    if (tss_create(&buffer_key, release_buffer) != thrd_success) {
+        return;
+    }
+    if (mtx_init(&drain_lock, mtx_plain) != thrd_success) {
+        return;
+    }
+    if (pthread_atfork(nullptr, nullptr, reset_logger_in_child) != 0) {
+        return;
+    }
+    if (thrd_create(&flusher_thread, flusher, nullptr) != thrd_success) {
+        return;
+    }
+    atomic_store(&running, true);
+    atexit(stop_logger);
+}
+
+/****************************************************************
+ * Writers
+ */
+
+static LogBuffer* get_thread_buffer()
+/*
+ * Return buffer of the current thread, take unowned or create new one if necessary.
+ * Return nullptr if messages should be written synchronously.
+ */
+{
+    call_once(&start_once, start_logger);
+    if (!atomic_load(&running)) {
+        return nullptr;
+    }
+    if (thread_buffer) {
+        return thread_buffer;
+    }
+    LogBuffer* buf;
+    for (buf = atomic_load(&buffers); buf; buf = buf->next) {
+        // take only drained buffers, so that the first messages of the thread are not dropped
+        bool owned = false;
+        if (atomic_load(&buf->head) == atomic_load(&buf->tail)
+                && atomic_compare_exchange_strong(&buf->owned, &owned, true)) {
+            break;
+        }
+    }
+    if (!buf) {
+        // mapped directly because the logger is used by allocators
+        buf = mmap(nullptr, sizeof(LogBuffer), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf == MAP_FAILED) {
+            return nullptr;
+        }
+        buf->owned = true;
+        buf->next = atomic_load(&buffers);
+        while (!atomic_compare_exchange_weak(&buffers, &buf->next, buf)) {}
+    }
+    tss_set(buffer_key, buf);
+    thread_buffer = buf;
+    return buf;
+}
+
+void log_vprintf(const char* prefix, const char* fmt, va_list ap)
+{
+    char msg[MAX_MESSAGE_SIZE];
+    size_t size = 0;
+    if (prefix) {
+        size = strlen(prefix);
+        if (size > sizeof(msg) - 1) {
+            size = sizeof(msg) - 1;
+        }
+        memcpy(msg, prefix, size);
+    }
+    int n = vsnprintf(msg + size, sizeof(msg) - size, fmt, ap);
+    if (n > 0) {
+        size += n;
+        if (size > sizeof(msg) - 1) {
+            size = sizeof(msg) - 1;
+        }
+    }
+    if (size == 0) {
+        return;
+    }
+
+    LogBuffer* buf = get_thread_buffer();
+    if (!buf) {
+        write_all((uint8_t*) msg, size);
+        return;
+    }
+    size_t head = atomic_load_explicit(&buf->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&buf->tail, memory_order_acquire);
+    if (LOG_BUFFER_SIZE - (head - tail) < size) {
+        atomic_fetch_add_explicit(&buf->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    size_t offset = head & (LOG_BUFFER_SIZE - 1);
+    size_t first = LOG_BUFFER_SIZE - offset;
+    if (first >= size) {
+        memcpy(buf->data + offset, msg, size);
+    } else {
+        memcpy(buf->data + offset, msg, first);
+        memcpy(buf->data, msg + first, size - first);
+    }
+    atomic_store_explicit(&buf->head, head + size, memory_order_release);
+}
+
+void log_printf(const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap);
+    log_vprintf(nullptr, fmt, ap);
+    va_end(ap);
+}
+
+void log_flush()
+{
+    if (atomic_load(&running)) {
+        drain();
+    }
+}
+
+void log_flush_and_abort()
+{
+    log_flush();
+    abort();
+}
+
+void set_log_fd(int fd)
+{
+    log_fd = fd;
+}
+
+size_t log_dropped_messages()
+{
+    size_t dropped = atomic_load(&total_dropped);
+    for (LogBuffer* buf = atomic_load(&buffers); buf; buf = buf->next) {
+        dropped += atomic_load(&buf->dropped);
+    }
+    return dropped;
+}
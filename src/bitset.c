@@ -0,0 +1,227 @@
+#include "bitset.h"
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+static inline unsigned count_run(Word* bitset, unsigned num_bits, unsigned offset, unsigned limit, Word invert)
+/*
+ * Count consecutive zero bits of bitset XOR invert.
+ */
+{
+    if (offset >= num_bits) {
+        return 0;
+    }
+    unsigned start = offset;
+    unsigned count = 0;
+    Word* ptr = &bitset[offset / WORD_WIDTH];
+
+    // count starting bits up to the the next word boundary
+    unsigned bit_index = offset & (WORD_WIDTH - 1);
+    if (bit_index) {
+        Word w = (*ptr++ ^ invert) >> bit_index;
+        if (w) {
+            // we have only ending bits
+            count = count_trailing_zeros(w);
+            goto out;
+        }
+        count = WORD_WIDTH - bit_index;
+        offset += count;
+    }
+
+#ifdef __SSE2__
+    // skip long runs 128 bits at a time
+    __m128i pattern = _mm_set1_epi8((char) invert);
+    while (offset + 128 <= num_bits && count < limit) {
+        __m128i v = _mm_loadu_si128((__m128i*) ptr);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, pattern)) != 0xFFFF) {
+            break;
+        }
+        ptr += 128 / WORD_WIDTH;
+        count += 128;
+        offset += 128;
+    }
+#endif
+
+    // count whole words
+    while (offset < num_bits && count < limit) {
+        Word w = *ptr++ ^ invert;
+        if (w) {
+            // count ending bits
+            count += count_trailing_zeros(w);
+            break;
+        }
+        count += WORD_WIDTH;
+        offset += WORD_WIDTH;
+    }
+
+out:
+    if (count > num_bits - start) {
+        count = num_bits - start;
+    }
+    return count;
+}
+
+unsigned bitset_count_zeros(Word* bitset, unsigned num_bits, unsigned offset, unsigned limit)
+{
+    return count_run(bitset, num_bits, offset, limit, 0);
+}
+
+unsigned bitset_count_ones(Word* bitset, unsigned num_bits, unsigned offset, unsigned limit)
+{
+    return count_run(bitset, num_bits, offset, limit, WORD_MAX);
+}
+
+void bitset_set_range(Word* bitset, unsigned offset, unsigned length)
+{
+    Word* ptr = &bitset[offset / WORD_WIDTH];
+
+    // set starting bits up to the the next word boundary
+    unsigned bit_index = offset & (WORD_WIDTH - 1);
+    if (bit_index) {
+        Word bitmask = WORD_MAX;
+        unsigned num_bits = WORD_WIDTH - bit_index;
+        if (length <= num_bits) {
+            bitmask &= (((Word) 1) << length) - 1;
+            num_bits = length;
+        }
+        bitmask <<= bit_index;
+        *ptr++ |= bitmask;
+        length -= num_bits;
+    }
+
+    // set remaining words
+    while (length >= WORD_WIDTH) {
+        *ptr++ = WORD_MAX;
+        length -= WORD_WIDTH;
+    }
+
+    // set ending bits
+    if (length) {
+        *ptr |= (((Word) 1) << length) - 1;
+    }
+}
+
+void bitset_clear_range(Word* bitset, unsigned offset, unsigned length)
+/*
+ * The logic is the same as in bitset_set_range.
+ */
+{
+    Word* ptr = &bitset[offset / WORD_WIDTH];
+
+    // clear starting bits up to the the next word boundary
+    unsigned bit_index = offset & (WORD_WIDTH - 1);
+    if (bit_index) {
+        Word bitmask = WORD_MAX;
+        unsigned num_bits = WORD_WIDTH - bit_index;
+        if (length <= num_bits) {
+            bitmask &= (((Word) 1) << length) - 1;
+            num_bits = length;
+        }
+        bitmask <<= bit_index;
+        *ptr++ &= ~bitmask;
+        length -= num_bits;
+    }
+
+    // clear remaining words
+    while (length >= WORD_WIDTH) {
+        *ptr++ = 0;
+        length -= WORD_WIDTH;
+    }
+
+    // clear ending bits
+    if (length) {
+        *ptr &= ~((((Word) 1) << length) - 1);
+    }
+}
+
+unsigned bitset_popcount(Word* bitset, unsigned offset, unsigned length)
+{
+    if (length == 0) {
+        return 0;
+    }
+    Word* ptr = &bitset[offset / WORD_WIDTH];
+    unsigned count = 0;
+
+    // starting bits
+    unsigned bit_index = offset & (WORD_WIDTH - 1);
+    if (bit_index) {
+        Word w = *ptr++ >> bit_index;
+        unsigned num_bits = WORD_WIDTH - bit_index;
+        if (length < num_bits) {
+            w &= (((Word) 1) << length) - 1;
+            num_bits = length;
+        }
+        count = count_ones(w);
+        length -= num_bits;
+    }
+
+    // whole words, four independent accumulators
+    unsigned c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    while (length >= 4 * WORD_WIDTH) {
+        c0 += count_ones(ptr[0]);
+        c1 += count_ones(ptr[1]);
+        c2 += count_ones(ptr[2]);
+        c3 += count_ones(ptr[3]);
+        ptr += 4;
+        length -= 4 * WORD_WIDTH;
+    }
+    count += c0 + c1 + c2 + c3;
+    while (length >= WORD_WIDTH) {
+        count += count_ones(*ptr++);
+        length -= WORD_WIDTH;
+    }
+
+    // ending bits
+    if (length) {
+        count += count_ones(*ptr & ((((Word) 1) << length) - 1));
+    }
+    return count;
+}
+
+unsigned bitset_find_zeros(Word* bitset, unsigned num_bits, unsigned offset, unsigned length)
+{
+    while (offset < num_bits) {
+        unsigned n = bitset_count_zeros(bitset, num_bits, offset, length);
+        if (n >= length) {
+            return offset;
+        }
+        offset += n;
+        offset += bitset_count_ones(bitset, num_bits, offset, UINT_MAX);
+    }
+    return BITSET_NOT_FOUND;
+}
+
+unsigned bitset_find_best_zeros(Word* bitset, unsigned num_bits, unsigned offset, unsigned length)
+{
+    unsigned best = BITSET_NOT_FOUND;
+    unsigned best_length = UINT_MAX;
+    while (offset < num_bits) {
+        unsigned n = bitset_count_zeros(bitset, num_bits, offset, num_bits - offset);
+        if (n >= length && n < best_length) {
+            best = offset;
+            best_length = n;
+            if (n == length) {
+                break;
+            }
+        }
+        offset += n;
+        offset += bitset_count_ones(bitset, num_bits, offset, num_bits - offset);
+    }
+    return best;
+}
+
+unsigned bitset_longest_zeros(Word* bitset, unsigned num_bits, unsigned offset)
+{
+    unsigned longest = 0;
+    while (offset < num_bits) {
+        unsigned n = num_bits - offset;
+        unsigned length = bitset_count_zeros(bitset, num_bits, offset, n);
+        if (length > longest) {
+            longest = length;
+        }
+        offset += length;
+        offset += bitset_count_ones(bitset, num_bits, offset, num_bits - offset);
+    }
+    return longest;
+}
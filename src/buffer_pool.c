@@ -0,0 +1,209 @@
+#include <errno.h>
+#include <limits.h>
+#include <threads.h>
+#include <sys/mman.h>
+
+#include "allocator.h"
+#include "buffer_pool.h"
+
+#define NUM_SHARDS  16  // threads are assigned to free lists round robin
+#define BATCH_SIZE  16  // buffers moved between per-thread and shared lists at once
+
+typedef struct _BufferChunk BufferChunk;
+
+struct _BufferChunk {
+    BufferChunk* next;
+    uint8_t* data;
+    size_t size;
+    unsigned num_buffers;
+    IoBuffer buffers[];
+};
+
+typedef struct {
+    mtx_t lock;
+    StackCache cache;
+} FreeList;
+
+struct _BufferPool {
+    unsigned buffer_size;
+    unsigned buffers_per_chunk;
+    bool lock_memory;
+    mtx_t lock;                // serializes adding chunks
+    LockFreeStack free_stack;  // shared, batches of free buffers
+    BufferChunk* chunks;
+    FreeList free_lists[NUM_SHARDS];
+};
+
+static atomic_uint next_shard = 0;
+static thread_local unsigned shard_index = UINT_MAX;
+
+static inline FreeList* get_free_list(BufferPool* pool)
+{
+    if (shard_index == UINT_MAX) {
+        shard_index = atomic_fetch_add(&next_shard, 1) % NUM_SHARDS;
+    }
+    return &pool->free_lists[shard_index];
+}
+
+static inline unsigned chunk_header_size(unsigned num_buffers)
+{
+    return sizeof(BufferChunk) + num_buffers * sizeof(IoBuffer);
+}
+
+static bool add_chunk(BufferPool* pool)
+/*
+ * Map new chunk and push its buffers to the shared stack in batches.
+ * Called with the pool lock held.
+ */
+{
+    unsigned n = pool->buffers_per_chunk;
+    BufferChunk* chunk = allocate(chunk_header_size(n), true);
+    if (!chunk) {
+        errno = ENOMEM;
+        return false;
+    }
+    chunk->size = (size_t) pool->buffer_size * n;
+    chunk->num_buffers = n;
+    chunk->data = mmap(nullptr, chunk->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk->data == MAP_FAILED) {
+        goto error;
+    }
+    if (pool->lock_memory && mlock(chunk->data, chunk->size) == -1) {
+        int err = errno;
+        munmap(chunk->data, chunk->size);
+        errno = err;
+        goto error;
+    }
+    StackNode* batch = nullptr;
+    unsigned batch_size = 0;
+    for (unsigned i = n; i--;) {
+        IoBuffer* buf = &chunk->buffers[i];
+        buf->data = chunk->data + (size_t) i * pool->buffer_size;
+        buf->pool = pool;
+        buf->node.next = batch;
+        batch = &buf->node;
+        if (++batch_size == BATCH_SIZE || i == 0) {
+            stack_push(&pool->free_stack, batch);
+            batch = nullptr;
+            batch_size = 0;
+        }
+    }
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    return true;
+
+error:
+    release((void**) &chunk, chunk_header_size(n));
+    return false;
+}
+
+/****************************************************************
+ * Public functions
+ */
+
+BufferPool* create_buffer_pool(unsigned buffer_size, unsigned buffers_per_chunk, bool lock_memory)
+{
+    if (buffer_size == 0 || buffer_size > UINT_MAX - sys_page_size || buffers_per_chunk == 0
+        || buffers_per_chunk > (UINT_MAX - sizeof(BufferChunk)) / sizeof(IoBuffer)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    BufferPool* pool = allocate(sizeof(BufferPool), true);
+    if (!pool) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    pool->buffer_size = align_unsigned_to_page(buffer_size);
+    pool->buffers_per_chunk = buffers_per_chunk;
+    pool->lock_memory = lock_memory;
+    init_lock_free_stack(&pool->free_stack);
+
+    if (mtx_init(&pool->lock, mtx_plain) != thrd_success) {
+        goto error;
+    }
+    unsigned i = 0;
+    for (; i < NUM_SHARDS; i++) {
+        if (mtx_init(&pool->free_lists[i].lock, mtx_plain) != thrd_success) {
+            break;
+        }
+    }
+    if (i < NUM_SHARDS) {
+        while (i--) {
+            mtx_destroy(&pool->free_lists[i].lock);
+        }
+        mtx_destroy(&pool->lock);
+        goto error;
+    }
+    return pool;
+
+error:
+    release((void**) &pool, sizeof(BufferPool));
+    errno = ENOMEM;
+    return nullptr;
+}
+
+void delete_buffer_pool(BufferPool** pool_ptr)
+{
+    if (!pool_ptr) {
+        return;
+    }
+    BufferPool* pool = *pool_ptr;
+    if (!pool) {
+        return;
+    }
+    for (BufferChunk* chunk = pool->chunks; chunk;) {
+        BufferChunk* next = chunk->next;
+        munmap(chunk->data, chunk->size);
+        release((void**) &chunk, chunk_header_size(pool->buffers_per_chunk));
+        chunk = next;
+    }
+    for (unsigned i = 0; i < NUM_SHARDS; i++) {
+        mtx_destroy(&pool->free_lists[i].lock);
+    }
+    mtx_destroy(&pool->lock);
+    release((void**) pool_ptr, sizeof(BufferPool));
+}
+
+unsigned buffer_pool_buffer_size(BufferPool* pool)
+{
+    return pool->buffer_size;
+}
+
+IoBuffer* get_io_buffer(BufferPool* pool)
+{
+    FreeList* list = get_free_list(pool);
+    mtx_lock(&list->lock);
+    IoBuffer* buf = (IoBuffer*) cache_pop(&list->cache, &pool->free_stack);
+    if (!buf) {
+        mtx_lock(&pool->lock);
+        // other thread could add chunk meanwhile
+        buf = (IoBuffer*) cache_pop(&list->cache, &pool->free_stack);
+        if (!buf && add_chunk(pool)) {
+            buf = (IoBuffer*) cache_pop(&list->cache, &pool->free_stack);
+        }
+        mtx_unlock(&pool->lock);
+        if (!buf) {
+            mtx_unlock(&list->lock);
+            return nullptr;
+        }
+    }
+    mtx_unlock(&list->lock);
+
+    buf->size = 0;
+    atomic_store_explicit(&buf->refcount, 1, memory_order_relaxed);
+    return buf;
+}
+
+void unref_io_buffer(IoBuffer** buf_ptr)
+{
+    IoBuffer* buf = *buf_ptr;
+    *buf_ptr = nullptr;
+    if (!buf || atomic_fetch_sub_explicit(&buf->refcount, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    BufferPool* pool = buf->pool;
+    FreeList* list = get_free_list(pool);
+    mtx_lock(&list->lock);
+    cache_push(&list->cache, &pool->free_stack, &buf->node, BATCH_SIZE);
+    mtx_unlock(&list->lock);
+}
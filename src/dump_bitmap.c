@@ -1,67 +1,172 @@
 #include <stddef.h>
+#include <string.h>
 
 #include "dump.h"
 
+/*
+ * Bits are expanded to characters eight at a time with SWAR arithmetic on 64-bit words
+ * and rows are formatted into a buffer written with single fwrite.
+ */
+
+static inline uint64_t load_le64(uint8_t* data)
+{
+    uint64_t w;
+    memcpy(&w, data, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+static inline void store_le64(char* p, uint64_t w)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    w = __builtin_bswap64(w);
+#endif
+    memcpy(p, &w, 8);
+}
+
+static inline uint64_t expand_bits(uint8_t b)
+/*
+ * Expand 8 bits to 8 characters, least significant bit first: '*' for 1, '.' for 0.
+ */
+{
+    // move bit i to byte i
+    uint64_t x = (b * 0x0101'0101'0101'0101UL) & 0x8040'2010'0804'0201UL;
+
+    // set high bit of each nonzero byte and move it to low bit
+    x = ((((x & 0x7F7F'7F7F'7F7F'7F7FUL) + 0x7F7F'7F7F'7F7F'7F7FUL) | x) & 0x8080'8080'8080'8080UL) >> 7;
+
+    static_assert('.' - '*' == 4);
+    return 0x2E2E'2E2E'2E2E'2E2EUL - x * 4;
+}
 
 static bool same_16_chars(uint8_t* block, uint8_t chr)
 /*
  * Check if 16 bytes of the block are equal to chr.
  */
 {
-    for (unsigned i = 0; i < 16; i++ ) {
-        if (block[i] != chr) {
-            return false;
-        }
-    }
-    return true;
+    uint64_t pattern = chr * 0x0101'0101'0101'0101UL;
+    uint64_t a, b;
+    memcpy(&a, block, 8);
+    memcpy(&b, block + 8, 8);
+    return ((a ^ pattern) | (b ^ pattern)) == 0;
 }
 
 void dump_bitmap(FILE* fp, uint8_t* data, unsigned size)
 {
+    // address, 16 * (8 chars + separator), some spare room
+    char row[32 + 16 * 9 + 8];
+
     bool prev_row_same_char = false;
     uint8_t prev_row_char = 0;
     bool skipping = false;
-    unsigned column = 0;
     for (unsigned i = 0; i < size;) {
-        if (column == 0) {
-            if (prev_row_same_char && size - i > 16
-                && (prev_row_char == 0 || prev_row_char == 0xFF)
-                && same_16_chars(data + i, prev_row_char)) {
-                i += 16;
-                if (!skipping) {
-                    skipping = true;
-                    fputs("---\n",  fp);
-                }
-                continue;
+        if (prev_row_same_char && size - i > 16
+            && (prev_row_char == 0 || prev_row_char == 0xFF)
+            && same_16_chars(data + i, prev_row_char)) {
+            i += 16;
+            if (!skipping) {
+                skipping = true;
+                fputs("---\n",  fp);
             }
-            prev_row_same_char = true;
-            prev_row_char = data[i];
-            skipping = false;
-            fprintf(fp, "%p: ", (void*) (((ptrdiff_t) data) + i));
+            continue;
         }
-        if (prev_row_char != data[i]) {
-            prev_row_same_char = false;
+        prev_row_same_char = true;
+        prev_row_char = data[i];
+        skipping = false;
+
+        char* p = row + snprintf(row, 32, "%p: ", (void*) (((ptrdiff_t) data) + i));
+        unsigned n = size - i;
+        if (n > 16) {
+            n = 16;
         }
-        uint8_t b = data[i++];
-        for (unsigned j = 0; j < 8; j++) {
-            if (b & 1) {
-                fputc('*', fp);
-            } else {
-                fputc('.', fp);
+        for (unsigned column = 0; column < n; column++) {
+            uint8_t b = data[i++];
+            if (prev_row_char != b) {
+                prev_row_same_char = false;
             }
-            b >>= 1;
+            store_le64(p, expand_bits(b));
+            p[8] = ' ';
+            p += 9;
         }
-        column++;
-        if (column == 8) {
-            fputc(' ', fp);
-        } else if (column == 16) {
+        if (n == 16) {
+            p[-1] = '\n';
+        } else {
+            *p++ = '\n';
+        }
+        fwrite(row, 1, p - row, fp);
+    }
+    if (size == 0 || (size & 15) == 0) {
+        fputc('\n', fp);
+    }
+}
+
+/****************************************************************
+ * Run-length summary.
+ */
+
+static unsigned count_run(uint8_t* data, unsigned num_bits, unsigned pos, bool bit)
+/*
+ * Count consecutive bits equal to `bit` starting from `pos`.
+ */
+{
+    unsigned start = pos;
+    unsigned num_bytes = (num_bits + 7) / 8;
+    while (pos < num_bits) {
+        unsigned byte_index = pos / 8;
+        unsigned avail = num_bytes - byte_index;
+        uint64_t w;
+        if (avail >= 8) {
+            w = load_le64(data + byte_index);
+            avail = 64;
+        } else {
+            uint8_t tail[8] = {};
+            memcpy(tail, data + byte_index, avail);
+            w = load_le64(tail);
+            avail *= 8;
+        }
+        if (bit) {
+            w = ~w;
+        }
+        unsigned shift = pos & 7;
+        w >>= shift;
+        avail -= shift;
+        if (w) {
+            unsigned n = __builtin_ctzl(w);
+            if (n < avail) {
+                pos += n;
+                break;
+            }
+        }
+        pos += avail;
+    }
+    if (pos > num_bits) {
+        pos = num_bits;
+    }
+    return pos - start;
+}
+
+void dump_bitmap_runs(FILE* fp, uint8_t* data, unsigned size)
+{
+    static_assert(sizeof(unsigned long) == 8);
+
+    unsigned num_bits = size * 8;
+    unsigned pos = 0;
+    unsigned column = 0;
+    while (pos < num_bits) {
+        if (column == 0) {
+            fprintf(fp, "%6u: ", pos);
+        }
+        bool bit = (data[pos / 8] >> (pos & 7)) & 1;
+        unsigned n = count_run(data, num_bits, pos, bit);
+        fprintf(fp, "%u%c", n, bit? '*' : '.');
+        pos += n;
+        if (++column == 16 || pos == num_bits) {
             fputc('\n', fp);
             column = 0;
         } else {
             fputc(' ', fp);
         }
     }
-    if (column < 16) {
-        fputc('\n', fp);
-    }
 }
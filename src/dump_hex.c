@@ -1,8 +1,14 @@
+#include <errno.h>
 #include <limits.h>
 //#include <stdbit.h> not in libc yet, using __builtin_* functions
 #include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <threads.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "allocator.h"
 #include "dump.h"
 
 static inline unsigned first_leading_one(size_t value)
@@ -12,73 +18,217 @@ static inline unsigned first_leading_one(size_t value)
     return ULONG_WIDTH - __builtin_clzl(value) - 1;
 }
 
-static void print_indent(FILE* fp, int indent)
+/****************************************************************
+ * Text formatting.
+ *
+ * Rows are formatted into memory buffers and written with fwrite,
+ * this is what makes parallel formatting possible.
+ */
+
+// maximal length of formatted row without indent: address, 16 hex bytes, separator, 16 chars, newline
+#define MAX_ROW_LENGTH  (16 + 2 + 16 * 3 + 2 + 1 + 16 + 1)
+
+typedef struct {
+    unsigned indent;
+    unsigned addr_width;
+    bool with_chars;
+} HexFormat;
+
+static char hexdigits[] = "0123456789ABCDEF";
+
+static unsigned calc_addr_width(size_t max_addr)
 {
-    for (int i = 0; i < indent; i++ ) {
-        fputc(' ', fp);
+    unsigned addr_width = (first_leading_one(max_addr | 1) + 3) >> 2;
+    if (addr_width < 4) {
+        addr_width = 4;
     }
+    return addr_width;
 }
 
-static char hexdigits[] = "0123456789ABCDEF";
+static char* format_indent(char* p, unsigned indent)
+{
+    memset(p, ' ', indent);
+    return p + indent;
+}
 
-static void print_addr(FILE* fp, uint8_t* addr, unsigned addr_width)
+static char* format_addr(char* p, size_t addr, unsigned addr_width)
 {
     unsigned shift = addr_width << 2;
     for (unsigned i = 0; i < addr_width; i++) {
         shift -= 4;
-        fputc(hexdigits[(((ptrdiff_t) addr) >> shift) & 15], fp);
+        *p++ = hexdigits[(addr >> shift) & 15];
+    }
+    *p++ = ':';
+    *p++ = ' ';
+    return p;
+}
+
+static inline char* format_hex(char* p, uint8_t data)
+{
+    *p++ = hexdigits[data >> 4];
+    *p++ = hexdigits[data & 15];
+    return p;
+}
+
+static inline char printable_char(uint8_t c)
+{
+    if (c < 32 || c > 127) {
+        c = '.';
     }
-    fputc(':', fp);
-    fputc(' ', fp);
+    return c;
 }
 
-static void print_hex(FILE* fp, uint8_t data)
+static char* format_partial_row(char* p, HexFormat* fmt, uint8_t* row, size_t display_addr,
+                                unsigned start, unsigned end)
+/*
+ * Format row with blank leading and trailing bytes.
+ * Bytes before `start` and from `end` are blank.
+ */
 {
-    fputc(hexdigits[data >> 4], fp);
-    fputc(hexdigits[data & 15], fp);
+    p = format_indent(p, fmt->indent);
+    p = format_addr(p, display_addr, fmt->addr_width);
+    unsigned j = 0;
+    for(; j < start; j++) {
+        if (j == 8) {
+            *p++ = ' ';
+            *p++ = ' ';
+        }
+        memset(p, ' ', 3);
+        p += 3;
+    }
+    for(; j < end; j++) {
+        if (j == 8) {
+            *p++ = '-';
+            *p++ = ' ';
+        }
+        p = format_hex(p, row[j]);
+        *p++ = ' ';
+    }
+    for(; j < 16; j++) {
+        if (j == 8) {
+            *p++ = ' ';
+            *p++ = ' ';
+        }
+        memset(p, ' ', 3);
+        p += 3;
+    }
+    if (fmt->with_chars) {
+        *p++ = ' ';
+        for(j = 0; j < start; j++) {
+            *p++ = ' ';
+        }
+        for(; j < end; j++) {
+            *p++ = printable_char(row[j]);
+        }
+    }
+    *p++ = '\n';
+    return p;
 }
 
-static void print_row(FILE* fp, uint8_t* addr, uint8_t* display_addr, unsigned addr_width, bool with_chars)
+static char* format_row(char* p, HexFormat* fmt, uint8_t* row, size_t display_addr)
 {
-    print_addr(fp, display_addr, addr_width);
+    p = format_indent(p, fmt->indent);
+    p = format_addr(p, display_addr, fmt->addr_width);
     for(unsigned i = 0; i < 16; i++) {
         if (i == 8) {
-            fputs("- ", fp);
+            *p++ = '-';
+            *p++ = ' ';
         }
-        print_hex(fp, addr[i]);
-        fputc(' ', fp);
+        p = format_hex(p, row[i]);
+        *p++ = ' ';
     }
-    if (with_chars) {
+    if (fmt->with_chars) {
         for(unsigned i = 0; i < 16; i++) {
-            uint8_t c = addr[i];
-            if (c < 32 || c > 127) {
-                c = '.';
-            }
-            fputc(c, fp);
+            *p++ = printable_char(row[i]);
         }
     }
-    fputc('\n', fp);
+    *p++ = '\n';
+    return p;
 }
 
-static void print_same_rows(FILE* fp, unsigned indent, unsigned num_same_rows,
-                            uint8_t* row, uint8_t* display_addr, unsigned addr_width, bool with_chars)
+static char* format_same_rows(char* p, HexFormat* fmt, size_t num_same_rows,
+                              uint8_t* row, size_t display_addr)
+/*
+ * Format the run of `num_same_rows` rows equal to `row` that ends at `display_addr`.
+ * The buffer must have room for at least 3 rows.
+ */
 {
     if (num_same_rows > 3) {
-        print_indent(fp, indent);
-        fprintf(fp, "-- %u same rows --\n", num_same_rows - 1);
-        print_indent(fp, indent);
-        print_row(fp, row, display_addr - 16, addr_width, with_chars);
-    } else if (num_same_rows) {
-        do {
-            print_indent(fp, indent);
-            print_row(fp, row, display_addr - (16 * num_same_rows), addr_width, with_chars);
-        } while (num_same_rows--);
+        p = format_indent(p, fmt->indent);
+        p += sprintf(p, "-- %zu same rows --\n", num_same_rows - 1);
+        p = format_row(p, fmt, row, display_addr - 16);
+    } else {
+        for (size_t n = num_same_rows; n; n--) {
+            p = format_row(p, fmt, row, display_addr - 16 * n);
+        }
     }
+    return p;
 }
 
+/****************************************************************
+ * Output buffer for FILE.
+ */
+
+#define OUTBUF_SIZE  8192
+
+typedef struct {
+    FILE* fp;
+    char* data;    // points to `small` or to mapped memory
+    size_t size;
+    char small[OUTBUF_SIZE];
+} OutBuf;
+
+static bool outbuf_init(OutBuf* out, FILE* fp, size_t reserve_size)
+/*
+ * Use the embedded buffer unless reservations do not fit in it, which happens with huge indent.
+ * Bigger buffer is mapped directly because dumps are used for allocator diagnostics.
+ * Return false if the buffer cannot be mapped.
+ */
+{
+    out->fp = fp;
+    out->data = out->small;
+    out->size = OUTBUF_SIZE;
+    if (reserve_size > OUTBUF_SIZE) {
+        char* data = mmap(nullptr, reserve_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+        out->data = data;
+        out->size = reserve_size;
+    }
+    return true;
+}
+
+static inline char* outbuf_reserve(OutBuf* out, char* p, size_t n)
+/*
+ * Make sure the buffer has room for n bytes, flush it if necessary.
+ * n must not exceed reserve_size passed to outbuf_init.
+ */
+{
+    if (p + n > out->data + out->size) {
+        fwrite(out->data, 1, p - out->data, out->fp);
+        p = out->data;
+    }
+    return p;
+}
+
+static inline void outbuf_flush(OutBuf* out, char* p)
+/*
+ * Write out the rest and release the buffer.
+ */
+{
+    fwrite(out->data, 1, p - out->data, out->fp);
+    if (out->data != out->small) {
+        munmap(out->data, out->size);
+    }
+}
+
+/****************************************************************
+ * Single-threaded dump.
+ */
+
 void dump_hex(FILE* fp, unsigned indent, uint8_t* addr, unsigned size, uint8_t* display_addr, bool aligned, bool with_chars)
 {
-//fprintf(fp, "DUMP: addr=%p, size=%u, display_addr=%p, ", addr, size, display_addr);
     unsigned offset;
     if (aligned) {
         offset = (unsigned) (((size_t) addr) & 15);
@@ -88,55 +238,29 @@ void dump_hex(FILE* fp, unsigned indent, uint8_t* addr, unsigned size, uint8_t*
     } else {
         offset = 0;
     }
-//fprintf(fp, "offset=%u, remainder=%u, size=%u\n", offset, size & 15, size - (size & 15));
-    uint8_t* max_addr = display_addr + size;
-    unsigned addr_width = (first_leading_one((size_t) max_addr) + 3) >> 2;
-    if (addr_width < 4) {
-        addr_width = 4;
+    HexFormat fmt = {
+        .indent = indent,
+        .addr_width = calc_addr_width((size_t) (display_addr + size)),
+        .with_chars = with_chars
+    };
+    // each reservation below covers up to three rows (see format_same_rows) plus the current one
+    size_t reserve_size = 4 * ((size_t) indent + MAX_ROW_LENGTH) + 32;
+
+    OutBuf out;
+    if (!outbuf_init(&out, fp, reserve_size)) {
+        return;
     }
+    char* p = out.data;
 
     unsigned i = 0;
 
     if (offset) {
         // print row with blank leading and trailing bytes
-        print_indent(fp, indent);
-        print_addr(fp, display_addr, addr_width);
         unsigned sz = (size < 16)? size : 16;
-        unsigned j = 0;
-        for(; j < offset; j++) {
-            if (j == 8) {
-                fputs("  ", fp);
-            }
-            fputs("   ", fp);
-        }
-        for(; j < sz; j++) {
-            if (j == 8) {
-                fputs("- ", fp);
-            }
-            print_hex(fp, addr[j]);
-            fputc(' ', fp);
-        }
-        for(; j < 16; j++) {
-            if (j == 8) {
-                fputs("  ", fp);
-            }
-            fputs("   ", fp);
-        }
-        if (with_chars) {
-            fputc(' ', fp);
-            for(j = 0; j < offset; j++) {
-                fputc(' ', fp);
-            }
-            for(; j < sz; j++) {
-                uint8_t c = addr[j];
-                if (c < 32 || c > 127) {
-                    c = '.';
-                }
-                fputc(c, fp);
-            }
-        }
-        fputc('\n', fp);
+        p = outbuf_reserve(&out, p, reserve_size);
+        p = format_partial_row(p, &fmt, addr, (size_t) display_addr, offset, sz);
         if (size < 16) {
+            outbuf_flush(&out, p);
             return;
         }
         i += 16;
@@ -152,17 +276,17 @@ void dump_hex(FILE* fp, unsigned indent, uint8_t* addr, unsigned size, uint8_t*
     unsigned num_same_rows = 0;
     uint8_t prev_row[16];
     while (i < size) {
+        p = outbuf_reserve(&out, p, reserve_size);
         if (num_rows) {
             // coalesce duplicate rows
             if (memcmp(addr, prev_row, 16) == 0) {
                 num_same_rows++;
                 goto _continue;
             }
-            print_same_rows(fp, indent, num_same_rows, prev_row, display_addr, addr_width, with_chars);
+            p = format_same_rows(p, &fmt, num_same_rows, prev_row, (size_t) display_addr);
             num_same_rows = 0;
         }
-        print_indent(fp, indent);
-        print_row(fp, addr, display_addr, addr_width, with_chars);
+        p = format_row(p, &fmt, addr, (size_t) display_addr);
         memcpy(prev_row, addr, 16);
 
 _continue:
@@ -171,41 +295,562 @@ _continue:
         display_addr += 16;
         num_rows++;
     }
-    print_same_rows(fp, indent, num_same_rows, prev_row, display_addr, addr_width, with_chars);
+    p = outbuf_reserve(&out, p, reserve_size);
+    p = format_same_rows(p, &fmt, num_same_rows, prev_row, (size_t) display_addr);
 
     // print last incomplete row
     if (remainder) {
-        print_indent(fp, indent);
-        print_addr(fp, display_addr, addr_width);
-        unsigned j = 0;
-        for(; j < remainder; j++) {
-            if (j == 8) {
-                fputs("- ", fp);
-            }
-            print_hex(fp, addr[j]);
-            fputc(' ', fp);
+        p = outbuf_reserve(&out, p, reserve_size);
+        p = format_partial_row(p, &fmt, addr, (size_t) display_addr, 0, remainder);
+    }
+    outbuf_flush(&out, p);
+}
+
+void dump_hex_simple(FILE* fp, uint8_t* data, unsigned size)
+{
+    dump_hex(fp, 0, data, size, data, true, true);
+}
+
+/****************************************************************
+ * Two-buffer diff.
+ */
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+static inline bool same_row(uint8_t* a, uint8_t* b)
+{
+#ifdef __SSE2__
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) a), _mm_loadu_si128((__m128i*) b));
+    return _mm_movemask_epi8(eq) == 0xFFFF;
+#else
+    uint64_t a0, a1, b0, b1;
+    memcpy(&a0, a, 8);
+    memcpy(&a1, a + 8, 8);
+    memcpy(&b0, b, 8);
+    memcpy(&b1, b + 8, 8);
+    return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+#endif
+}
+
+static size_t find_different_row(uint8_t* a, uint8_t* b, size_t offset, size_t end)
+/*
+ * Return offset of the first different row starting from `offset` or `end` if all rows are same.
+ * `end` must be multiple of 16.
+ */
+{
+    // skip equal regions by 64 bytes
+    while (offset + 64 <= end) {
+#ifdef __SSE2__
+        __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (a + offset)),
+                                     _mm_loadu_si128((__m128i*) (b + offset)));
+        __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (a + offset + 16)),
+                                     _mm_loadu_si128((__m128i*) (b + offset + 16)));
+        __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (a + offset + 32)),
+                                     _mm_loadu_si128((__m128i*) (b + offset + 32)));
+        __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) (a + offset + 48)),
+                                     _mm_loadu_si128((__m128i*) (b + offset + 48)));
+        __m128i eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+        if (_mm_movemask_epi8(eq) != 0xFFFF) {
+            break;
         }
+#else
+        if (memcmp(a + offset, b + offset, 64)) {
+            break;
+        }
+#endif
+        offset += 64;
+    }
+    for (; offset < end; offset += 16) {
+        if (!same_row(a + offset, b + offset)) {
+            break;
+        }
+    }
+    return offset;
+}
+
+static char* format_diff_row(char* p, HexFormat* fmt, char sign, uint8_t* row, uint8_t* other,
+                             size_t display_addr, unsigned length)
+/*
+ * Format `length` bytes of `row` prefixed with `sign`.
+ * If `other` is not null, bytes equal to `other` are shown as dots and blanks.
+ */
+{
+    p = format_indent(p, fmt->indent);
+    *p++ = sign;
+    *p++ = ' ';
+    p = format_addr(p, display_addr, fmt->addr_width);
+    unsigned j = 0;
+    for(; j < length; j++) {
+        if (j == 8) {
+            *p++ = '-';
+            *p++ = ' ';
+        }
+        if (other && row[j] == other[j]) {
+            *p++ = '.';
+            *p++ = '.';
+        } else {
+            p = format_hex(p, row[j]);
+        }
+        *p++ = ' ';
+    }
+    if (fmt->with_chars) {
         for(; j < 16; j++) {
             if (j == 8) {
-                fputs("  ", fp);
+                *p++ = ' ';
+                *p++ = ' ';
             }
-            fputs("   ", fp);
-        }
-        if (with_chars) {
-            fputc(' ', fp);
-            for(j = 0; j < remainder; j++) {
-                uint8_t c = addr[j];
-                if (c < 32 || c > 127) {
-                    c = '.';
-                }
-                fputc(c, fp);
+            memset(p, ' ', 3);
+            p += 3;
+        }
+        for(j = 0; j < length; j++) {
+            if (other && row[j] == other[j]) {
+                *p++ = ' ';
+            } else {
+                *p++ = printable_char(row[j]);
             }
         }
-        fputc('\n', fp);
     }
+    *p++ = '\n';
+    return p;
 }
 
-void dump_hex_simple(FILE* fp, uint8_t* data, unsigned size)
+size_t dump_hex_diff(FILE* fp, unsigned indent, uint8_t* a, uint8_t* b, size_t size, uint8_t* display_addr)
 {
-    dump_hex(fp, 0, data, size, data, true, true);
+    HexFormat fmt = {
+        .indent = indent,
+        .addr_width = calc_addr_width((size_t) (display_addr + size)),
+        .with_chars = true
+    };
+    size_t reserve_size = 3 * ((size_t) indent + 2 + MAX_ROW_LENGTH) + 32;
+
+    OutBuf out;
+    if (!outbuf_init(&out, fp, reserve_size)) {
+        return 0;
+    }
+    char* p = out.data;
+
+    size_t num_different_rows = 0;
+    size_t end = size & ~(size_t) 15;
+    size_t offset = 0;
+    for (;;) {
+        size_t next = find_different_row(a, b, offset, end);
+        unsigned length = 16;
+        if (next == end) {
+            // last incomplete row
+            length = size & 15;
+            if (length == 0 || memcmp(a + next, b + next, length) == 0) {
+                next = size;
+            }
+        }
+        p = outbuf_reserve(&out, p, reserve_size);
+        if (next != offset && num_different_rows) {
+            p = format_indent(p, indent);
+            p += sprintf(p, "-- %zu same rows --\n", (next - offset + 15) / 16);
+        }
+        if (next == size) {
+            break;
+        }
+        p = format_diff_row(p, &fmt, '-', a + next, nullptr, (size_t) display_addr + next, length);
+        p = format_diff_row(p, &fmt, '+', b + next, a + next, (size_t) display_addr + next, length);
+        num_different_rows++;
+        offset = next + length;
+    }
+    outbuf_flush(&out, p);
+    return num_different_rows;
+}
+
+/****************************************************************
+ * Streaming parallel dump.
+ *
+ * Input is split into chunks which are formatted by worker threads
+ * and written by the calling thread in order.
+ *
+ * Worker does not know whether the previous chunk ends with a run of same rows,
+ * so it does not print leading rows equal to the last row of the previous chunk
+ * and does not print the trailing run of same rows.
+ * Instead, it leaves their counts in the chunk and the writer merges runs
+ * across chunk boundaries. This makes the output identical to dump_hex.
+ */
+
+#define DUMP_CHUNK_SIZE  (1024 * 1024)  // must be multiple of 16
+
+typedef struct {
+    uint8_t* data;        // points either to mapped input or to `buffer`
+    size_t   size;
+    size_t   display_addr;
+
+    uint8_t* buffer;      // input buffer for read mode
+    char*    text;        // formatted rows
+    size_t   text_length;
+
+    bool     has_prev_row;
+    uint8_t  prev_row[16];   // last row of the previous chunk
+    unsigned num_lead_same;  // number of leading rows equal to prev_row
+    unsigned num_tail_same;  // number of trailing rows equal to last_row, not formatted
+    uint8_t  last_row[16];   // last formatted row
+
+    bool     ready;
+} HexChunk;
+
+typedef struct {
+    HexFormat fmt;
+
+    // input: either mapped memory or file descriptor
+    uint8_t* data;
+    int      fd;
+    size_t   size;
+    size_t   display_addr;
+
+    HexChunk* chunks;
+    unsigned  num_slots;
+
+    mtx_t  lock;
+    cnd_t  chunk_ready;
+    cnd_t  slot_released;
+    size_t num_chunks;     // can decrease in read mode on EOF
+    size_t next_claimed;
+    size_t next_written;
+    uint8_t last_read_row[16];  // for read mode
+    bool   read_error;
+
+    char*  write_buffer;   // for rows formatted by the writer, up to 3 same rows and a partial one
+} HexDumper;
+
+static size_t read_full(int fd, uint8_t* buffer, size_t size, bool* error)
+{
+    size_t total = 0;
+    while (total < size) {
+        ssize_t n = read(fd, buffer + total, size - total);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            *error = true;
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+static size_t claim_chunk(HexDumper* dumper)
+/*
+ * Claim next chunk and prepare its input. Return chunk index or SIZE_MAX if no more chunks.
+ */
+{
+    mtx_lock(&dumper->lock);
+    while (dumper->next_claimed < dumper->num_chunks
+           && dumper->next_claimed - dumper->next_written >= dumper->num_slots) {
+        cnd_wait(&dumper->slot_released, &dumper->lock);
+    }
+    size_t k = dumper->next_claimed;
+    if (k >= dumper->num_chunks) {
+        mtx_unlock(&dumper->lock);
+        return SIZE_MAX;
+    }
+    dumper->next_claimed++;
+
+    HexChunk* chunk = &dumper->chunks[k % dumper->num_slots];
+    size_t start = k * DUMP_CHUNK_SIZE;
+    size_t size = dumper->size - start;
+    if (size > DUMP_CHUNK_SIZE) {
+        size = DUMP_CHUNK_SIZE;
+    }
+    chunk->display_addr = dumper->display_addr + start;
+    chunk->has_prev_row = k > 0;
+
+    if (dumper->data) {
+        chunk->data = dumper->data + start;
+        if (k) {
+            memcpy(chunk->prev_row, chunk->data - 16, 16);
+        }
+    } else {
+        // reading is sequential, so it's done under the lock
+        chunk->data = chunk->buffer;
+        size = read_full(dumper->fd, chunk->buffer, size, &dumper->read_error);
+        memcpy(chunk->prev_row, dumper->last_read_row, 16);
+        if (size >= 16) {
+            memcpy(dumper->last_read_row, chunk->data + (size & ~15UL) - 16, 16);
+        }
+        if (size < DUMP_CHUNK_SIZE) {
+            // EOF or error, this is the last chunk
+            dumper->num_chunks = k + 1;
+            cnd_broadcast(&dumper->slot_released);
+        }
+    }
+    chunk->size = size;
+    mtx_unlock(&dumper->lock);
+    return k;
+}
+
+static void format_chunk(HexFormat* fmt, HexChunk* chunk)
+{
+    uint8_t* row = chunk->data;
+    size_t display_addr = chunk->display_addr;
+    size_t num_rows = chunk->size / 16;
+    size_t i = 0;
+
+    chunk->num_lead_same = 0;
+    if (chunk->has_prev_row) {
+        while (i < num_rows && memcmp(row, chunk->prev_row, 16) == 0) {
+            i++;
+            row += 16;
+            display_addr += 16;
+        }
+        chunk->num_lead_same = i;
+    }
+
+    char* p = chunk->text;
+    unsigned num_same_rows = 0;
+    uint8_t* prev_row = nullptr;
+    for (; i < num_rows; i++, row += 16, display_addr += 16) {
+        if (prev_row) {
+            if (memcmp(row, prev_row, 16) == 0) {
+                num_same_rows++;
+                continue;
+            }
+            p = format_same_rows(p, fmt, num_same_rows, prev_row, display_addr);
+            num_same_rows = 0;
+        }
+        p = format_row(p, fmt, row, display_addr);
+        prev_row = row;
+    }
+    if (prev_row) {
+        memcpy(chunk->last_row, prev_row, 16);
+    }
+    chunk->num_tail_same = num_same_rows;
+    chunk->text_length = p - chunk->text;
+}
+
+static int dump_worker(void* arg)
+{
+    HexDumper* dumper = arg;
+    for (;;) {
+        size_t k = claim_chunk(dumper);
+        if (k == SIZE_MAX) {
+            return 0;
+        }
+        HexChunk* chunk = &dumper->chunks[k % dumper->num_slots];
+        format_chunk(&dumper->fmt, chunk);
+
+        mtx_lock(&dumper->lock);
+        chunk->ready = true;
+        cnd_broadcast(&dumper->chunk_ready);
+        mtx_unlock(&dumper->lock);
+    }
+}
+
+static void write_chunks(HexDumper* dumper, FILE* fp)
+/*
+ * Write formatted chunks in order, merging runs of same rows across chunk boundaries.
+ */
+{
+    HexFormat* fmt = &dumper->fmt;
+    char* buffer = dumper->write_buffer;
+    char* p;
+
+    size_t num_same_rows = 0;
+    uint8_t same_row[16];
+    size_t end_addr = dumper->display_addr;
+
+    for (size_t k = 0;; k++) {
+        mtx_lock(&dumper->lock);
+        HexChunk* chunk = &dumper->chunks[k % dumper->num_slots];
+        while (k < dumper->num_chunks && !chunk->ready) {
+            cnd_wait(&dumper->chunk_ready, &dumper->lock);
+        }
+        if (k >= dumper->num_chunks) {
+            mtx_unlock(&dumper->lock);
+            break;
+        }
+        mtx_unlock(&dumper->lock);
+
+        size_t num_rows = chunk->size / 16;
+        end_addr = chunk->display_addr + num_rows * 16;
+        if (chunk->num_lead_same < num_rows) {
+            num_same_rows += chunk->num_lead_same;
+            p = format_same_rows(buffer, fmt, num_same_rows, same_row,
+                                 chunk->display_addr + chunk->num_lead_same * 16);
+            fwrite(buffer, 1, p - buffer, fp);
+            fwrite(chunk->text, 1, chunk->text_length, fp);
+            num_same_rows = chunk->num_tail_same;
+            memcpy(same_row, chunk->last_row, 16);
+        } else {
+            // whole chunk continues the run
+            num_same_rows += num_rows;
+        }
+        if (chunk->size & 15) {
+            // last incomplete row
+            p = format_same_rows(buffer, fmt, num_same_rows, same_row, end_addr);
+            p = format_partial_row(p, fmt, chunk->data + num_rows * 16, end_addr, 0, chunk->size & 15);
+            fwrite(buffer, 1, p - buffer, fp);
+            num_same_rows = 0;
+        }
+
+        mtx_lock(&dumper->lock);
+        chunk->ready = false;
+        dumper->next_written++;
+        cnd_broadcast(&dumper->slot_released);
+        mtx_unlock(&dumper->lock);
+    }
+    p = format_same_rows(buffer, fmt, num_same_rows, same_row, end_addr);
+    fwrite(buffer, 1, p - buffer, fp);
+}
+
+static bool run_dumper(HexDumper* dumper, FILE* fp, unsigned num_threads)
+{
+    if (num_threads == 0) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (n > 0)? n : 1;
+    }
+    size_t num_chunks = dumper->size / DUMP_CHUNK_SIZE + ((dumper->size % DUMP_CHUNK_SIZE) != 0);
+    if (num_threads > num_chunks) {
+        num_threads = num_chunks? num_chunks : 1;
+    }
+    dumper->num_chunks = num_chunks;
+    dumper->num_slots = num_threads * 2;
+    dumper->next_claimed = 0;
+    dumper->next_written = 0;
+    dumper->read_error = false;
+
+    // worst case is a row with a single byte followed by 3 same rows
+    size_t row_size = (size_t) dumper->fmt.indent + MAX_ROW_LENGTH;
+    size_t text_size = (DUMP_CHUNK_SIZE / 16 + 4) * row_size;
+    size_t write_buffer_size = 4 * row_size + 32;
+    if (text_size > UINT_MAX) {
+        // does not fit allocator's size type
+        errno = EINVAL;
+        return false;
+    }
+
+    bool result = false;
+    unsigned num_created = 0;
+    thrd_t threads[num_threads];
+
+    dumper->write_buffer = allocate(write_buffer_size, false);
+    if (!dumper->write_buffer) {
+        return false;
+    }
+    dumper->chunks = allocate(dumper->num_slots * sizeof(HexChunk), true);
+    if (!dumper->chunks) {
+        release((void**) &dumper->write_buffer, write_buffer_size);
+        return false;
+    }
+    for (unsigned i = 0; i < dumper->num_slots; i++) {
+        HexChunk* chunk = &dumper->chunks[i];
+        chunk->text = allocate(text_size, false);
+        if (!chunk->text) {
+            goto out;
+        }
+        if (!dumper->data) {
+            chunk->buffer = allocate(DUMP_CHUNK_SIZE, false);
+            if (!chunk->buffer) {
+                goto out;
+            }
+        }
+    }
+    if (mtx_init(&dumper->lock, mtx_plain) != thrd_success) {
+        goto out;
+    }
+    if (cnd_init(&dumper->chunk_ready) != thrd_success) {
+        goto out_mtx;
+    }
+    if (cnd_init(&dumper->slot_released) != thrd_success) {
+        goto out_cnd;
+    }
+    for (; num_created < num_threads; num_created++) {
+        if (thrd_create(&threads[num_created], dump_worker, dumper) != thrd_success) {
+            break;
+        }
+    }
+    if (num_created) {
+        write_chunks(dumper, fp);
+        result = !dumper->read_error;
+    }
+    for (unsigned i = 0; i < num_created; i++) {
+        thrd_join(threads[i], nullptr);
+    }
+
+    cnd_destroy(&dumper->slot_released);
+out_cnd:
+    cnd_destroy(&dumper->chunk_ready);
+out_mtx:
+    mtx_destroy(&dumper->lock);
+out:
+    for (unsigned i = 0; i < dumper->num_slots; i++) {
+        HexChunk* chunk = &dumper->chunks[i];
+        release((void**) &chunk->text, text_size);
+        release((void**) &chunk->buffer, DUMP_CHUNK_SIZE);
+    }
+    release((void**) &dumper->chunks, dumper->num_slots * sizeof(HexChunk));
+    release((void**) &dumper->write_buffer, write_buffer_size);
+    return result;
+}
+
+bool dump_hex_parallel(FILE* fp, unsigned indent, uint8_t* addr, size_t size, uint8_t* display_addr,
+                       bool with_chars, unsigned num_threads)
+{
+    HexDumper dumper = {
+        .fmt = {
+            .indent = indent,
+            .addr_width = calc_addr_width((size_t) (display_addr + size)),
+            .with_chars = with_chars
+        },
+        .data = addr,
+        .fd = -1,
+        .size = size,
+        .display_addr = (size_t) display_addr
+    };
+    return run_dumper(&dumper, fp, num_threads);
+}
+
+bool dump_hex_fd(FILE* fp, int fd, off_t offset, size_t size, bool with_chars, unsigned num_threads)
+{
+    HexDumper dumper = {
+        .fmt = {
+            .indent = 0,
+            .with_chars = with_chars
+        },
+        .fd = fd,
+        .display_addr = offset
+    };
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        // read mode, offset is used for display only
+        dumper.size = size;
+        dumper.fmt.addr_width = calc_addr_width((size == SIZE_MAX)? size : (size_t) offset + size);
+        return run_dumper(&dumper, fp, num_threads);
+    }
+
+    // map file
+    if (offset >= st.st_size) {
+        return true;
+    }
+    if (size > (size_t) (st.st_size - offset)) {
+        size = st.st_size - offset;
+    }
+    off_t map_offset = offset & ~((off_t) sysconf(_SC_PAGE_SIZE) - 1);
+    size_t map_size = size + (offset - map_offset);
+    uint8_t* map = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, map_offset);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    madvise(map, map_size, MADV_SEQUENTIAL);
+
+    dumper.data = map + (offset - map_offset);
+    dumper.size = size;
+    dumper.fmt.addr_width = calc_addr_width((size_t) offset + size);
+    bool result = run_dumper(&dumper, fp, num_threads);
+
+    munmap(map, map_size);
+    return result;
 }
@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#include "hash_map.h"
+
+/*
+ * Blocks of this size and bigger are grown in place.
+ */
+#define REMAP_THRESHOLD  (1024 * 1024)
+
+static inline unsigned max_growth(unsigned capacity)
+/*
+ * Maximal load factor is 7/8.
+ */
+{
+    return capacity - capacity / 8;
+}
+
+static inline unsigned block_size(unsigned capacity, unsigned slot_size)
+{
+    return capacity * slot_size + capacity + HASH_MAP_GROUP_WIDTH;
+}
+
+static bool capacity_fits(unsigned capacity, unsigned slot_size)
+{
+    return capacity <= (UINT_MAX - HASH_MAP_GROUP_WIDTH) / (slot_size + 1);
+}
+
+static void set_block(HashMap* map, uint8_t* block, unsigned capacity, unsigned slot_size)
+{
+    map->slots = block;
+    map->ctrl = (int8_t*) (block + capacity * slot_size);
+    map->capacity = capacity;
+    map->nbytes = block_size(capacity, slot_size);
+}
+
+static void mirror_ctrl(HashMap* map)
+{
+    memcpy(map->ctrl + map->capacity, map->ctrl, HASH_MAP_GROUP_WIDTH);
+}
+
+static void rehash_in_place(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash)
+/*
+ * Put items marked as DELETED to their places, all other control bytes must be EMPTY.
+ * The item stays in place if it's in the same group as the first non-full slot
+ * in its probe sequence. Otherwise it's moved to an empty slot or swapped
+ * with another item that awaits rehashing.
+ */
+{
+    uint8_t tmp[slot_size];
+    unsigned mask = map->capacity - 1;
+
+    for (unsigned i = 0; i < map->capacity; i++) {
+        if (map->ctrl[i] != HASH_MAP_DELETED) {
+            continue;
+        }
+        uint8_t* slot = map->slots + i * slot_size;
+        uint64_t hash = slot_hash(slot);
+        unsigned target = hash_map_find_non_full(map, hash);
+        unsigned probe_start = hash_map_h1(hash) & mask;
+        int8_t h2 = hash_map_h2(hash);
+
+        if (((i - probe_start) & mask) / HASH_MAP_GROUP_WIDTH
+            == ((target - probe_start) & mask) / HASH_MAP_GROUP_WIDTH) {
+            hash_map_set_ctrl(map, i, h2);
+            continue;
+        }
+        uint8_t* target_slot = map->slots + target * slot_size;
+        if (map->ctrl[target] == HASH_MAP_EMPTY) {
+            memcpy(target_slot, slot, slot_size);
+            hash_map_set_ctrl(map, target, h2);
+            hash_map_set_ctrl(map, i, HASH_MAP_EMPTY);
+        } else {
+            memcpy(tmp, target_slot, slot_size);
+            memcpy(target_slot, slot, slot_size);
+            memcpy(slot, tmp, slot_size);
+            hash_map_set_ctrl(map, target, h2);
+            // process swapped item
+            i--;
+        }
+    }
+    map->growth_left = max_growth(map->capacity) - map->size;
+}
+
+static void drop_deleted(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash)
+/*
+ * Rehash without resizing to get rid of DELETED control bytes.
+ */
+{
+    for (unsigned i = 0; i < map->capacity; i++) {
+        // full -> DELETED, DELETED -> EMPTY
+        map->ctrl[i] = (map->ctrl[i] < 0)? HASH_MAP_EMPTY : HASH_MAP_DELETED;
+    }
+    mirror_ctrl(map);
+    rehash_in_place(map, slot_size, slot_hash);
+}
+
+static bool grow_in_place(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash, unsigned new_capacity)
+/*
+ * Extend the block with reallocate, move control bytes to the new end and rehash in place.
+ */
+{
+    unsigned old_capacity = map->capacity;
+    void* block = map->slots;
+    if (!map->allocator->reallocate(&block, map->nbytes, block_size(new_capacity, slot_size), false, nullptr)) {
+        return false;
+    }
+    int8_t* old_ctrl = (int8_t*) block + old_capacity * slot_size;
+    set_block(map, block, new_capacity, slot_size);
+
+    memmove(map->ctrl, old_ctrl, old_capacity);
+    for (unsigned i = 0; i < old_capacity; i++) {
+        map->ctrl[i] = (map->ctrl[i] < 0)? HASH_MAP_EMPTY : HASH_MAP_DELETED;
+    }
+    memset(map->ctrl + old_capacity, HASH_MAP_EMPTY, new_capacity - old_capacity);
+    mirror_ctrl(map);
+    rehash_in_place(map, slot_size, slot_hash);
+    return true;
+}
+
+static bool resize(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash, unsigned new_capacity)
+{
+    if (!capacity_fits(new_capacity, slot_size)) {
+        errno = ENOMEM;
+        return false;
+    }
+    if (map->capacity && map->nbytes >= REMAP_THRESHOLD) {
+        return grow_in_place(map, slot_size, slot_hash, new_capacity);
+    }
+
+    uint8_t* block = map->allocator->allocate(block_size(new_capacity, slot_size), false);
+    if (!block) {
+        return false;
+    }
+    HashMap old_map = *map;
+    set_block(map, block, new_capacity, slot_size);
+    memset(map->ctrl, HASH_MAP_EMPTY, new_capacity + HASH_MAP_GROUP_WIDTH);
+
+    for (unsigned i = 0; i < old_map.capacity; i++) {
+        if (old_map.ctrl[i] < 0) {
+            continue;
+        }
+        uint8_t* slot = old_map.slots + i * slot_size;
+        uint64_t hash = slot_hash(slot);
+        unsigned index = hash_map_find_non_full(map, hash);
+        hash_map_set_ctrl(map, index, hash_map_h2(hash));
+        memcpy(map->slots + index * slot_size, slot, slot_size);
+    }
+    map->growth_left = max_growth(new_capacity) - map->size;
+
+    if (old_map.capacity) {
+        map->allocator->release((void**) &old_map.slots, old_map.nbytes);
+    }
+    return true;
+}
+
+bool hash_map_make_room(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash)
+{
+    if (map->capacity == 0) {
+        return resize(map, slot_size, slot_hash, HASH_MAP_GROUP_WIDTH);
+    }
+    if (map->size <= max_growth(map->capacity) / 2) {
+        // mostly tombstones
+        drop_deleted(map, slot_size, slot_hash);
+        return true;
+    }
+    if (map->capacity > UINT_MAX / 2) {
+        errno = ENOMEM;
+        return false;
+    }
+    return resize(map, slot_size, slot_hash, map->capacity * 2);
+}
+
+bool hash_map_reserve(HashMap* map, unsigned slot_size, HashMapSlotHash slot_hash, unsigned num_items)
+{
+    unsigned capacity = map->capacity? map->capacity : HASH_MAP_GROUP_WIDTH;
+    while (max_growth(capacity) < num_items) {
+        if (capacity > UINT_MAX / 2) {
+            errno = ENOMEM;
+            return false;
+        }
+        capacity *= 2;
+    }
+    if (capacity == map->capacity) {
+        return true;
+    }
+    return resize(map, slot_size, slot_hash, capacity);
+}
+
+void hash_map_destroy(HashMap* map)
+{
+    if (map->capacity) {
+        map->allocator->release((void**) &map->slots, map->nbytes);
+    }
+    map->ctrl = nullptr;
+    map->capacity = 0;
+    map->size = 0;
+    map->growth_left = 0;
+    map->nbytes = 0;
+}
@@ -0,0 +1,315 @@
+#include <errno.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <threads.h>
+
+#include "allocator.h"
+#include "bitset.h"
+#include "id_allocator.h"
+
+#define MAX_LEVELS  8   // enough for UINT_MAX IDs with 32-bit words
+#define NUM_SHARDS  16  // threads are assigned to cache shards round robin
+
+typedef struct {
+    mtx_t lock;
+    unsigned count;
+    unsigned* ids;  // 2 * batch_size entries, the lowest ID is on top
+} IdCache;
+
+struct _IdAllocator {
+    unsigned capacity;
+    unsigned num_levels;
+    unsigned bitmap_size;  // in bytes, for all levels
+    Word* levels[MAX_LEVELS];
+    mtx_t lock;
+    unsigned batch_size;
+    IdCache caches[NUM_SHARDS];
+};
+
+static atomic_uint next_shard = 0;
+static thread_local unsigned shard_index = UINT_MAX;
+
+/****************************************************************
+ * Bitmap levels, called with the lock held.
+ */
+
+static void mark_full(IdAllocator* allocator, unsigned word_index)
+/*
+ * Set summary bits for full word of level 0.
+ */
+{
+    for (unsigned k = 1; k < allocator->num_levels; k++) {
+        Word* w = &allocator->levels[k][word_index / WORD_WIDTH];
+        *w |= ((Word) 1) << (word_index & (WORD_WIDTH - 1));
+        if (*w != WORD_MAX) {
+            break;
+        }
+        word_index /= WORD_WIDTH;
+    }
+}
+
+static void mark_not_full(IdAllocator* allocator, unsigned word_index)
+/*
+ * Clear summary bits for level 0 word that was full.
+ */
+{
+    for (unsigned k = 1; k < allocator->num_levels; k++) {
+        Word* w = &allocator->levels[k][word_index / WORD_WIDTH];
+        bool was_full = *w == WORD_MAX;
+        *w &= ~(((Word) 1) << (word_index & (WORD_WIDTH - 1)));
+        if (!was_full) {
+            break;
+        }
+        word_index /= WORD_WIDTH;
+    }
+}
+
+static unsigned take_ids(IdAllocator* allocator, unsigned* ids, unsigned max_ids)
+/*
+ * Take up to max_ids lowest free IDs, store them in ascending order.
+ */
+{
+    unsigned n = 0;
+    unsigned top = allocator->num_levels - 1;
+    while (n < max_ids && allocator->levels[top][0] != WORD_MAX) {
+        // descend to the first level 0 word with free bits
+        unsigned index = 0;
+        for (unsigned k = top; k > 0; k--) {
+            index = index * WORD_WIDTH + count_trailing_zeros(~allocator->levels[k][index]);
+        }
+        Word* word = &allocator->levels[0][index];
+        Word w = *word;
+        while (n < max_ids && w != WORD_MAX) {
+            unsigned bit = count_trailing_zeros(~w);
+            w |= ((Word) 1) << bit;
+            ids[n++] = index * WORD_WIDTH + bit;
+        }
+        *word = w;
+        if (w == WORD_MAX) {
+            mark_full(allocator, index);
+        }
+    }
+    return n;
+}
+
+static void return_id(IdAllocator* allocator, unsigned id)
+{
+    Word* word = &allocator->levels[0][id / WORD_WIDTH];
+    if (*word == WORD_MAX) {
+        mark_not_full(allocator, id / WORD_WIDTH);
+    }
+    *word &= ~(((Word) 1) << (id & (WORD_WIDTH - 1)));
+}
+
+/****************************************************************
+ * Public functions
+ */
+
+IdAllocator* create_id_allocator(unsigned capacity, unsigned batch_size)
+{
+    if (capacity == 0 || capacity == ID_NONE) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    IdAllocator* allocator = allocate(sizeof(IdAllocator), true);
+    if (!allocator) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    allocator->capacity = capacity;
+    allocator->batch_size = batch_size;
+
+    // calculate levels
+    unsigned num_bits[MAX_LEVELS];
+    unsigned num_words[MAX_LEVELS];
+    unsigned total_words = 0;
+    unsigned k = 0;
+    num_bits[0] = capacity;
+    for (;;) {
+        num_words[k] = bitset_num_words(num_bits[k]);
+        total_words += num_words[k];
+        if (num_words[k] == 1) {
+            break;
+        }
+        k++;
+        num_bits[k] = num_words[k - 1];
+    }
+    allocator->num_levels = k + 1;
+
+    // allocate all levels in one block
+    allocator->bitmap_size = total_words * sizeof(Word);
+    Word* bitmap = allocate(allocator->bitmap_size, true);
+    if (!bitmap) {
+        release((void**) &allocator, sizeof(IdAllocator));
+        errno = ENOMEM;
+        return nullptr;
+    }
+    for (k = 0; k < allocator->num_levels; k++) {
+        allocator->levels[k] = bitmap;
+        // padding bits are never free
+        unsigned padding = num_words[k] * WORD_WIDTH - num_bits[k];
+        if (padding) {
+            bitset_set_range(bitmap, num_bits[k], padding);
+        }
+        bitmap += num_words[k];
+    }
+
+    if (mtx_init(&allocator->lock, mtx_plain) != thrd_success) {
+        goto error;
+    }
+    unsigned i = 0;
+    if (batch_size) {
+        for (; i < NUM_SHARDS; i++) {
+            IdCache* cache = &allocator->caches[i];
+            cache->ids = allocate(2 * batch_size * sizeof(unsigned), false);
+            if (!cache->ids) {
+                break;
+            }
+            if (mtx_init(&cache->lock, mtx_plain) != thrd_success) {
+                release((void**) &cache->ids, 2 * batch_size * sizeof(unsigned));
+                break;
+            }
+        }
+        if (i < NUM_SHARDS) {
+            while (i--) {
+                mtx_destroy(&allocator->caches[i].lock);
+                release((void**) &allocator->caches[i].ids, 2 * batch_size * sizeof(unsigned));
+            }
+            mtx_destroy(&allocator->lock);
+            goto error;
+        }
+    }
+    return allocator;
+
+error:
+    release((void**) &allocator->levels[0], allocator->bitmap_size);
+    release((void**) &allocator, sizeof(IdAllocator));
+    errno = ENOMEM;
+    return nullptr;
+}
+
+void delete_id_allocator(IdAllocator** allocator_ptr)
+{
+    if (!allocator_ptr) {
+        return;
+    }
+    IdAllocator* allocator = *allocator_ptr;
+    if (!allocator) {
+        return;
+    }
+    if (allocator->batch_size) {
+        for (unsigned i = 0; i < NUM_SHARDS; i++) {
+            mtx_destroy(&allocator->caches[i].lock);
+            release((void**) &allocator->caches[i].ids, 2 * allocator->batch_size * sizeof(unsigned));
+        }
+    }
+    mtx_destroy(&allocator->lock);
+    release((void**) &allocator->levels[0], allocator->bitmap_size);
+    release((void**) allocator_ptr, sizeof(IdAllocator));
+}
+
+static inline IdCache* get_cache(IdAllocator* allocator)
+{
+    if (shard_index == UINT_MAX) {
+        shard_index = atomic_fetch_add(&next_shard, 1) % NUM_SHARDS;
+    }
+    return &allocator->caches[shard_index];
+}
+
+static void refill_cache(IdAllocator* allocator, IdCache* cache)
+/*
+ * Take a batch of IDs to the empty cache. Called with the cache lock held.
+ */
+{
+    mtx_lock(&allocator->lock);
+    unsigned n = take_ids(allocator, cache->ids, allocator->batch_size);
+    mtx_unlock(&allocator->lock);
+    // reverse, so the lowest ID is on top
+    for (unsigned i = 0; i < n / 2; i++) {
+        unsigned id = cache->ids[i];
+        cache->ids[i] = cache->ids[n - 1 - i];
+        cache->ids[n - 1 - i] = id;
+    }
+    cache->count = n;
+}
+
+static void drain_caches(IdAllocator* allocator)
+/*
+ * Return IDs of all caches to the bitmap. Called without cache locks held,
+ * cache locks are taken one at a time, so this does not deadlock with other threads.
+ */
+{
+    for (unsigned i = 0; i < NUM_SHARDS; i++) {
+        IdCache* cache = &allocator->caches[i];
+        mtx_lock(&cache->lock);
+        if (cache->count) {
+            mtx_lock(&allocator->lock);
+            for (unsigned j = 0; j < cache->count; j++) {
+                return_id(allocator, cache->ids[j]);
+            }
+            mtx_unlock(&allocator->lock);
+            cache->count = 0;
+        }
+        mtx_unlock(&cache->lock);
+    }
+}
+
+unsigned allocate_id(IdAllocator* allocator)
+{
+    unsigned id = ID_NONE;
+
+    if (allocator->batch_size == 0) {
+        mtx_lock(&allocator->lock);
+        take_ids(allocator, &id, 1);
+        mtx_unlock(&allocator->lock);
+        return id;
+    }
+
+    IdCache* cache = get_cache(allocator);
+    mtx_lock(&cache->lock);
+    if (cache->count == 0) {
+        refill_cache(allocator, cache);
+        if (cache->count == 0) {
+            // the bitmap is exhausted, but free IDs may sit in caches of other threads
+            mtx_unlock(&cache->lock);
+            drain_caches(allocator);
+            mtx_lock(&cache->lock);
+            if (cache->count == 0) {
+                refill_cache(allocator, cache);
+            }
+        }
+    }
+    if (cache->count) {
+        id = cache->ids[--cache->count];
+    }
+    mtx_unlock(&cache->lock);
+    return id;
+}
+
+void release_id(IdAllocator* allocator, unsigned id)
+{
+    if (id >= allocator->capacity) {
+        return;
+    }
+    if (allocator->batch_size == 0) {
+        mtx_lock(&allocator->lock);
+        return_id(allocator, id);
+        mtx_unlock(&allocator->lock);
+        return;
+    }
+
+    IdCache* cache = get_cache(allocator);
+    mtx_lock(&cache->lock);
+    if (cache->count == 2 * allocator->batch_size) {
+        // return the bottom half, keep recently released IDs
+        mtx_lock(&allocator->lock);
+        for (unsigned i = 0; i < allocator->batch_size; i++) {
+            return_id(allocator, cache->ids[i]);
+        }
+        mtx_unlock(&allocator->lock);
+        cache->count -= allocator->batch_size;
+        memmove(cache->ids, cache->ids + allocator->batch_size, cache->count * sizeof(unsigned));
+    }
+    cache->ids[cache->count++] = id;
+    mtx_unlock(&cache->lock);
+}
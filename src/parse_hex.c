@@ -0,0 +1,306 @@
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+#include "dump.h"
+
+#ifdef __SSE2__
+#   include <emmintrin.h>
+#endif
+
+/****************************************************************
+ * Raw hex decoder.
+ */
+
+static inline int hex_value(uint8_t c)
+{
+    if ((unsigned) (c - '0') < 10) {
+        return c - '0';
+    }
+    c |= 0x20;  // lower case
+    if ((unsigned) (c - 'a') < 6) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+#ifdef __SSE2__
+
+    static inline __m128i decode_nibbles(__m128i v, __m128i* invalid)
+    /*
+     * Convert 16 hex characters to nibble values, accumulate invalid characters mask.
+     */
+    {
+        // digits: '0'..'9' -> 0..9
+        __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(d, _mm_set1_epi8(-1)),
+                                         _mm_cmplt_epi8(d, _mm_set1_epi8(10)));
+        // letters: 'a'..'f', 'A'..'F' -> 10..15
+        __m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)), _mm_set1_epi8('a' - 10));
+        __m128i is_letter = _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8(9)),
+                                          _mm_cmplt_epi8(l, _mm_set1_epi8(16)));
+
+        *invalid = _mm_or_si128(*invalid, _mm_andnot_si128(_mm_or_si128(is_digit, is_letter),
+                                                           _mm_set1_epi8(-1)));
+        return _mm_or_si128(_mm_and_si128(is_digit, d), _mm_and_si128(is_letter, l));
+    }
+
+    static inline __m128i pack_nibbles(__m128i n)
+    /*
+     * Combine pairs of nibbles into bytes, result is in low bytes of 16-bit lanes.
+     */
+    {
+        __m128i hi = _mm_slli_epi16(_mm_and_si128(n, _mm_set1_epi16(0x00FF)), 4);
+        __m128i lo = _mm_srli_epi16(n, 8);
+        return _mm_or_si128(hi, lo);
+    }
+
+#endif
+
+bool hex_decode(uint8_t* dest, char* src, size_t num_bytes)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i invalid = _mm_setzero_si128();
+    for (; i + 16 <= num_bytes; i += 16) {
+        __m128i n0 = decode_nibbles(_mm_loadu_si128((__m128i*) (src + i * 2)), &invalid);
+        __m128i n1 = decode_nibbles(_mm_loadu_si128((__m128i*) (src + i * 2 + 16)), &invalid);
+        __m128i bytes = _mm_packus_epi16(pack_nibbles(n0), pack_nibbles(n1));
+        _mm_storeu_si128((__m128i*) (dest + i), bytes);
+    }
+    if (_mm_movemask_epi8(invalid)) {
+        return false;
+    }
+#endif
+
+    for (; i < num_bytes; i++) {
+        int hi = hex_value(src[i * 2]);
+        int lo = hex_value(src[i * 2 + 1]);
+        if ((hi | lo) < 0) {
+            return false;
+        }
+        dest[i] = (hi << 4) | lo;
+    }
+    return true;
+}
+
+/****************************************************************
+ * dump_hex output parser.
+ */
+
+typedef struct {
+    uint8_t* data;
+    unsigned size;
+    unsigned capacity;
+} ParseBuffer;
+
+static bool reserve(ParseBuffer* buf, size_t size)
+{
+    if (size <= buf->capacity) {
+        return true;
+    }
+    if (size > UINT_MAX) {
+        return false;
+    }
+    size_t capacity = buf->capacity? buf->capacity : 4096;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+    if (capacity > UINT_MAX) {
+        capacity = UINT_MAX;
+    }
+    if (!reallocate((void**) &buf->data, buf->capacity, capacity, false, nullptr)) {
+        return false;
+    }
+    buf->capacity = capacity;
+    return true;
+}
+
+static bool parse_same_rows(char* line, char* end, size_t* num_same_rows)
+/*
+ * Parse `-- N same rows --` line.
+ */
+{
+    static char prefix[] = "-- ";
+    static char suffix[] = " same rows --";
+    if (end - line < (ptrdiff_t) (sizeof(prefix) - 1 + sizeof(suffix) - 1 + 1)
+        || memcmp(line, prefix, sizeof(prefix) - 1)) {
+        return false;
+    }
+    char* p = line + sizeof(prefix) - 1;
+    char* num_end;
+    *num_same_rows = strtoul(p, &num_end, 10);
+    return num_end != p
+        && end - num_end >= (ptrdiff_t) (sizeof(suffix) - 1)
+        && memcmp(num_end, suffix, sizeof(suffix) - 1) == 0;
+}
+
+static bool parse_row(char* line, char* end, size_t* row_addr, uint8_t row[16], unsigned* start, unsigned* stop)
+/*
+ * Parse row of hex dump. Bytes can be blank at the beginning and at the end of the row.
+ * Return row address and the range of present bytes.
+ */
+{
+    // address
+    size_t addr = 0;
+    char* p = line;
+    for (; p < end && *p != ':'; p++) {
+        int v = hex_value(*p);
+        if (v < 0) {
+            return false;
+        }
+        addr = (addr << 4) | v;
+    }
+    if (p == line || end - p < 2 || p[1] != ' ') {
+        return false;
+    }
+    p += 2;
+    *row_addr = addr;
+
+    // gather hex pairs to decode them at once
+    char hex[32];
+    unsigned n = 0;
+    *start = 16;
+    *stop = 0;
+    for (unsigned j = 0; j < 16; j++) {
+        char* col = p + 3 * j + ((j >= 8)? 2 : 0);
+        if (j == 8 && col - 2 < end && col[-2] != '-' && col[-2] != ' ') {
+            return false;
+        }
+        if (col + 1 >= end || (col[0] == ' ' && col[1] == ' ')) {
+            // blank
+            if (n && *stop == 0) {
+                *stop = j;
+            }
+            continue;
+        }
+        if (*stop) {
+            // gap in the middle of row
+            return false;
+        }
+        if (n == 0) {
+            *start = j;
+        }
+        memcpy(hex + n * 2, col, 2);
+        n++;
+    }
+    if (n == 0) {
+        return false;
+    }
+    if (*stop == 0) {
+        *stop = 16;
+    }
+    return hex_decode(row + *start, hex, n);
+}
+
+uint8_t* parse_hex_dump(char* text, size_t length, unsigned* size, size_t* addr)
+{
+    ParseBuffer buf = {};
+    size_t base_addr = 0;
+    size_t num_same_rows = 0;
+    bool has_rows = false;
+    uint8_t row[16];
+    uint8_t prev_row[16] = {};
+
+    char* text_end = text + length;
+    for (char* line = text; line < text_end;) {
+        char* end = memchr(line, '\n', text_end - line);
+        char* next_line;
+        if (end) {
+            next_line = end + 1;
+        } else {
+            next_line = end = text_end;
+        }
+        if (end > line && end[-1] == '\r') {
+            end--;
+        }
+        // skip indent
+        while (line < end && *line == ' ') {
+            line++;
+        }
+        if (line == end) {
+            // empty line
+            line = next_line;
+            continue;
+        }
+
+        if (*line == '-') {
+            if (!has_rows || !parse_same_rows(line, end, &num_same_rows)) {
+                goto error;
+            }
+            line = next_line;
+            continue;
+        }
+
+        size_t row_addr;
+        unsigned start, stop;
+        if (!parse_row(line, end, &row_addr, row, &start, &stop)) {
+            goto error;
+        }
+        if (!has_rows) {
+            base_addr = row_addr + start;
+            has_rows = true;
+        } else {
+            size_t expected_addr = base_addr + buf.size;
+            if (start || row_addr < expected_addr || (row_addr - expected_addr) % 16) {
+                goto error;
+            }
+            // fill the run of same rows
+            size_t num_missing = (row_addr - expected_addr) / 16;
+            if (num_missing != num_same_rows) {
+                goto error;
+            }
+            if (num_missing) {
+                if (!reserve(&buf, buf.size + num_missing * 16)) {
+                    goto error_nomem;
+                }
+                for (size_t i = 0; i < num_missing; i++) {
+                    memcpy(buf.data + buf.size, prev_row, 16);
+                    buf.size += 16;
+                }
+            }
+        }
+        num_same_rows = 0;
+
+        if (!reserve(&buf, buf.size + (stop - start))) {
+            goto error_nomem;
+        }
+        memcpy(buf.data + buf.size, row + start, stop - start);
+        buf.size += stop - start;
+        memcpy(prev_row, row, 16);
+
+        line = next_line;
+    }
+    if (num_same_rows) {
+        // dangling marker
+        goto error;
+    }
+
+    // shrink buffer to the exact size so the caller can release it
+    if (buf.size == 0) {
+        release((void**) &buf.data, buf.capacity);
+        errno = EINVAL;
+        return nullptr;
+    }
+    if (!reallocate((void**) &buf.data, buf.capacity, buf.size, false, nullptr)) {
+        goto error_nomem;
+    }
+    *size = buf.size;
+    if (addr) {
+        *addr = base_addr;
+    }
+    return buf.data;
+
+error:
+    release((void**) &buf.data, buf.capacity);
+    errno = EINVAL;
+    return nullptr;
+
+error_nomem:
+    release((void**) &buf.data, buf.capacity);
+    errno = ENOMEM;
+    return nullptr;
+}
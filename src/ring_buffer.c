@@ -0,0 +1,148 @@
+#ifndef _GNU_SOURCE
+#   define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "allocator.h"
+#include "ring_buffer.h"
+
+RingBuffer* create_ring_buffer(size_t capacity)
+{
+    int err;
+    if (capacity == 0) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    capacity = (capacity + sys_page_size - 1) & ~((size_t) sys_page_size - 1);
+
+    RingBuffer* rb = allocate(sizeof(RingBuffer), true);
+    if (!rb) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    int fd = memfd_create("ring_buffer", MFD_CLOEXEC);
+    if (fd == -1) {
+        err = errno;
+        goto err_release;
+    }
+    if (ftruncate(fd, capacity) == -1) {
+        err = errno;
+        goto err_close;
+    }
+
+    // reserve address space for both mappings
+    uint8_t* data = mmap(nullptr, 2 * capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) {
+        err = errno;
+        goto err_close;
+    }
+    for (unsigned i = 0; i < 2; i++) {
+        void* addr = mmap(data + i * capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        if (addr == MAP_FAILED) {
+            err = errno;
+            munmap(data, 2 * capacity);
+            goto err_close;
+        }
+    }
+    // mappings keep the file
+    close(fd);
+
+    rb->data = data;
+    rb->capacity = capacity;
+    return rb;
+
+err_close:
+    close(fd);
+
+err_release:
+    release((void**) &rb, sizeof(RingBuffer));
+    errno = err;
+    return nullptr;
+}
+
+void delete_ring_buffer(RingBuffer** rb_ptr)
+{
+    if (!rb_ptr) {
+        return;
+    }
+    RingBuffer* rb = *rb_ptr;
+    if (rb) {
+        munmap(rb->data, 2 * rb->capacity);
+        release((void**) rb_ptr, sizeof(RingBuffer));
+    }
+}
+
+/****************************************************************
+ * Copying helpers.
+ */
+
+bool ring_buffer_write(RingBuffer* rb, void* data, size_t size)
+{
+    size_t available;
+    uint8_t* dest = ring_buffer_write_ptr(rb, &available);
+    if (size > available) {
+        return false;
+    }
+    memcpy(dest, data, size);
+    ring_buffer_commit(rb, size);
+    return true;
+}
+
+size_t ring_buffer_read(RingBuffer* rb, void* dest, size_t size)
+{
+    size_t available;
+    uint8_t* src = ring_buffer_read_ptr(rb, &available);
+    if (size > available) {
+        size = available;
+    }
+    memcpy(dest, src, size);
+    ring_buffer_consume(rb, size);
+    return size;
+}
+
+/****************************************************************
+ * Zero-copy I/O.
+ */
+
+size_t ring_buffer_read_iov(RingBuffer* rb, struct iovec* iov)
+{
+    iov->iov_base = ring_buffer_read_ptr(rb, &iov->iov_len);
+    return iov->iov_len;
+}
+
+size_t ring_buffer_write_iov(RingBuffer* rb, struct iovec* iov)
+{
+    iov->iov_base = ring_buffer_write_ptr(rb, &iov->iov_len);
+    return iov->iov_len;
+}
+
+ssize_t ring_buffer_readv(RingBuffer* rb, int fd)
+{
+    struct iovec iov;
+    if (ring_buffer_write_iov(rb, &iov) == 0) {
+        errno = ENOBUFS;
+        return -1;
+    }
+    ssize_t result = readv(fd, &iov, 1);
+    if (result > 0) {
+        ring_buffer_commit(rb, result);
+    }
+    return result;
+}
+
+ssize_t ring_buffer_writev(RingBuffer* rb, int fd)
+{
+    struct iovec iov;
+    if (ring_buffer_read_iov(rb, &iov) == 0) {
+        return 0;
+    }
+    ssize_t result = writev(fd, &iov, 1);
+    if (result > 0) {
+        ring_buffer_consume(rb, result);
+    }
+    return result;
+}
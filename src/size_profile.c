@@ -0,0 +1,395 @@
+#include <errno.h>
+#include <float.h>
+#include <inttypes.h>
+#include <string.h>
+#include <threads.h>
+#include <sys/mman.h>
+
+#include "size_profile.h"
+
+#define MAX_PROFILES      8  // profiles enabled at the same time
+#define NUM_SIZE_CLASSES  8  // suggested by the report
+#define MIN_ALIGNMENT     16 // guaranteed by all allocators of the library
+
+typedef struct _SizeCounters SizeCounters;
+
+struct _SizeCounters {
+    SizeCounters* next;
+    // updated by the owner thread only
+    _Atomic(uint64_t) count[SIZE_PROFILE_NUM_BUCKETS];
+    _Atomic(uint64_t) bytes[SIZE_PROFILE_NUM_BUCKETS];
+};
+
+struct _SizeProfile {
+    unsigned slot;         // index in per-thread arrays
+    uint64_t generation;   // tells the profile from previous ones in the same slot
+    mtx_t lock;
+    SizeCounters* counters;
+};
+
+static atomic_uint used_slots = 0;
+static _Atomic(uint64_t) next_generation = 1;
+
+static thread_local SizeCounters* thread_counters[MAX_PROFILES];
+static thread_local uint64_t thread_generations[MAX_PROFILES];
+
+/*
+ * Profiles and counters are mapped directly to keep them apart from profiled allocators.
+ */
+
+static void* map_zeroed(size_t size)
+{
+    void* result = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return (result == MAP_FAILED)? nullptr : result;
+}
+
+static SizeCounters* attach_thread(SizeProfile* profile)
+{
+    SizeCounters* counters = map_zeroed(sizeof(SizeCounters));
+    if (!counters) {
+        return nullptr;
+    }
+    mtx_lock(&profile->lock);
+    counters->next = profile->counters;
+    profile->counters = counters;
+    mtx_unlock(&profile->lock);
+
+    thread_counters[profile->slot] = counters;
+    thread_generations[profile->slot] = profile->generation;
+    return counters;
+}
+
+void size_profile_record(SizeProfile* profile, unsigned nbytes)
+{
+    unsigned slot = profile->slot;
+    SizeCounters* counters = thread_counters[slot];
+    if (!counters || thread_generations[slot] != profile->generation) {
+        counters = attach_thread(profile);
+        if (!counters) {
+            return;
+        }
+    }
+    unsigned bucket = size_bucket(nbytes);
+    uint64_t n = atomic_load_explicit(&counters->count[bucket], memory_order_relaxed);
+    atomic_store_explicit(&counters->count[bucket], n + 1, memory_order_relaxed);
+    n = atomic_load_explicit(&counters->bytes[bucket], memory_order_relaxed);
+    atomic_store_explicit(&counters->bytes[bucket], n + nbytes, memory_order_relaxed);
+}
+
+bool enable_size_profile(Allocator* allocator)
+{
+    if (!allocator->stats) {
+        errno = ENOTSUP;
+        return false;
+    }
+    if (allocator->stats->size_profile) {
+        return true;
+    }
+    unsigned used = atomic_load(&used_slots);
+    unsigned slot;
+    do {
+        if (used == (1U << MAX_PROFILES) - 1) {
+            errno = ENOSPC;
+            return false;
+        }
+        slot = __builtin_ctz(~used);
+    } while (!atomic_compare_exchange_weak(&used_slots, &used, used | (1U << slot)));
+
+    SizeProfile* profile = map_zeroed(sizeof(SizeProfile));
+    if (!profile) {
+        atomic_fetch_and(&used_slots, ~(1U << slot));
+        return false;
+    }
+    if (mtx_init(&profile->lock, mtx_plain) != thrd_success) {
+        munmap(profile, sizeof(SizeProfile));
+        atomic_fetch_and(&used_slots, ~(1U << slot));
+        errno = ENOMEM;
+        return false;
+    }
+    profile->slot = slot;
+    profile->generation = atomic_fetch_add(&next_generation, 1);
+    allocator->stats->size_profile = profile;
+    return true;
+}
+
+void disable_size_profile(Allocator* allocator)
+{
+    SizeProfile* profile = allocator->stats? allocator->stats->size_profile : nullptr;
+    if (!profile) {
+        return;
+    }
+    allocator->stats->size_profile = nullptr;
+
+    for (SizeCounters* counters = profile->counters; counters;) {
+        SizeCounters* next = counters->next;
+        munmap(counters, sizeof(SizeCounters));
+        counters = next;
+    }
+    mtx_destroy(&profile->lock);
+    atomic_fetch_and(&used_slots, ~(1U << profile->slot));
+    munmap(profile, sizeof(SizeProfile));
+}
+
+bool read_size_profile(Allocator* allocator, SizeHistogram* histogram)
+{
+    SizeProfile* profile = allocator->stats? allocator->stats->size_profile : nullptr;
+    if (!profile) {
+        return false;
+    }
+    memset(histogram, 0, sizeof(SizeHistogram));
+    mtx_lock(&profile->lock);
+    for (SizeCounters* counters = profile->counters; counters; counters = counters->next) {
+        for (unsigned i = 0; i < SIZE_PROFILE_NUM_BUCKETS; i++) {
+            histogram->count[i] += atomic_load_explicit(&counters->count[i], memory_order_relaxed);
+            histogram->bytes[i] += atomic_load_explicit(&counters->bytes[i], memory_order_relaxed);
+        }
+    }
+    mtx_unlock(&profile->lock);
+    return true;
+}
+
+/****************************************************************
+ * Report
+ */
+
+typedef struct {
+    unsigned page_size;
+    unsigned unit_size;
+    unsigned header_size;       // bitmap page header, in bytes
+    unsigned max_bitmap_block;
+} Geometry;
+
+typedef struct {
+    uint64_t small_blocks;
+    uint64_t small_bytes;       // requested
+    double small_rounding;      // bytes wasted by rounding to units
+    double small_headers;       // share of bitmap page headers
+    uint64_t large_blocks;
+    uint64_t large_bytes;
+    double large_rounding;      // bytes wasted by rounding to pages
+} Waste;
+
+static inline uint64_t align_size(uint64_t n, uint64_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+static double rounding_waste(uint64_t lower, uint64_t upper, uint64_t alignment)
+/*
+ * Average waste per size from lower to upper, exclusively,
+ * when sizes are rounded up to `alignment`.
+ */
+{
+    if (lower >= upper) {
+        return 0;
+    }
+    if (lower % alignment == 0 && upper % alignment == 0) {
+        return (alignment - 1) / 2.0;
+    }
+    // bucket is narrower than alignment here, so the loop is short
+    uint64_t sum = 0;
+    for (uint64_t n = lower; n < upper; n++) {
+        sum += align_size(n, alignment) - n;
+    }
+    return (double) sum / (upper - lower);
+}
+
+static void make_geometry(unsigned page_size, unsigned unit_size, unsigned bitmap_offset, Geometry* geometry)
+/*
+ * Same calculations as in pet_allocator init.
+ */
+{
+    unsigned units_per_page = page_size / unit_size;
+    unsigned header_units = (bitmap_offset + units_per_page / 8 + unit_size - 1) / unit_size;
+    geometry->page_size = page_size;
+    geometry->unit_size = unit_size;
+    geometry->header_size = header_units * unit_size;
+    geometry->max_bitmap_block = (units_per_page - header_units - 1) * unit_size;
+}
+
+static void estimate_waste(SizeHistogram* histogram, Geometry* geometry, Waste* waste)
+{
+    memset(waste, 0, sizeof(Waste));
+    for (unsigned i = 0; i < SIZE_PROFILE_NUM_BUCKETS; i++) {
+        uint64_t count = histogram->count[i];
+        if (!count) {
+            continue;
+        }
+        uint64_t lower = size_bucket_lower(i);
+        uint64_t upper = size_bucket_upper(i);
+        uint64_t cutover = (uint64_t) geometry->max_bitmap_block + 1;
+        if (upper <= cutover) {
+            waste->small_blocks += count;
+            waste->small_bytes += histogram->bytes[i];
+            waste->small_rounding += count * rounding_waste(lower, upper, geometry->unit_size);
+        } else if (lower >= cutover) {
+            waste->large_blocks += count;
+            waste->large_bytes += histogram->bytes[i];
+            waste->large_rounding += count * rounding_waste(lower, upper, geometry->page_size);
+        } else {
+            // bucket is split by the cutover, assume even spread for bytes too
+            double small_share = (double) (cutover - lower) / (upper - lower);
+            uint64_t small_count = count * small_share;
+            uint64_t small_bytes = histogram->bytes[i] * small_share;
+            waste->small_blocks += small_count;
+            waste->small_bytes += small_bytes;
+            waste->small_rounding += small_count * rounding_waste(lower, cutover, geometry->unit_size);
+            waste->large_blocks += count - small_count;
+            waste->large_bytes += histogram->bytes[i] - small_bytes;
+            waste->large_rounding += (count - small_count) * rounding_waste(cutover, upper, geometry->page_size);
+        }
+    }
+    // headers take the same share of every page
+    double used = waste->small_bytes + waste->small_rounding;
+    waste->small_headers = used * geometry->header_size / (geometry->page_size - geometry->header_size);
+}
+
+static double total_waste(Waste* waste)
+{
+    return waste->small_rounding + waste->small_headers + waste->large_rounding;
+}
+
+static double percent(double part, double whole)
+{
+    return whole? 100.0 * part / whole : 0;
+}
+
+static unsigned suggest_size_classes(SizeHistogram* histogram, Geometry* geometry,
+                                     uint64_t* classes, double* class_waste)
+/*
+ * Pick up to NUM_SIZE_CLASSES classes for bitmap blocks that minimize rounding waste.
+ * Class sizes are bucket upper bounds rounded to units,
+ * all sizes from a bucket go to the same class.
+ * Return the number of classes.
+ */
+{
+    // non-empty buckets and prefix sums
+    unsigned buckets[SIZE_PROFILE_NUM_BUCKETS];
+    double sum_count[SIZE_PROFILE_NUM_BUCKETS + 1];
+    double sum_bytes[SIZE_PROFILE_NUM_BUCKETS + 1];
+    unsigned m = 0;
+    sum_count[0] = 0;
+    sum_bytes[0] = 0;
+    for (unsigned i = 0; i < SIZE_PROFILE_NUM_BUCKETS; i++) {
+        if (histogram->count[i] && size_bucket_upper(i) <= (uint64_t) geometry->max_bitmap_block + 1) {
+            buckets[m] = i;
+            sum_count[m + 1] = sum_count[m] + histogram->count[i];
+            sum_bytes[m + 1] = sum_bytes[m] + histogram->bytes[i];
+            m++;
+        }
+    }
+    if (m == 0) {
+        *class_waste = 0;
+        return 0;
+    }
+    unsigned k_max = (m < NUM_SIZE_CLASSES)? m : NUM_SIZE_CLASSES;
+
+    // waste[k][j]: the least waste for buckets 0..j with k+1 classes, the last one ends at j
+    double waste[NUM_SIZE_CLASSES][SIZE_PROFILE_NUM_BUCKETS];
+    unsigned start[NUM_SIZE_CLASSES][SIZE_PROFILE_NUM_BUCKETS];
+
+    for (unsigned k = 0; k < k_max; k++) {
+        for (unsigned j = 0; j < m; j++) {
+            double class_size = align_size(size_bucket_upper(buckets[j]) - 1, geometry->unit_size);
+            waste[k][j] = DBL_MAX;
+            // the last class covers buckets i..j
+            unsigned i_max = k? j : 0;
+            for (unsigned i = k; i <= i_max; i++) {
+                double w = class_size * (sum_count[j + 1] - sum_count[i]) - (sum_bytes[j + 1] - sum_bytes[i]);
+                if (k) {
+                    if (waste[k - 1][i - 1] == DBL_MAX) {
+                        continue;
+                    }
+                    w += waste[k - 1][i - 1];
+                }
+                if (w < waste[k][j]) {
+                    waste[k][j] = w;
+                    start[k][j] = i;
+                }
+            }
+        }
+    }
+    // walk back from the largest bucket
+    unsigned k = k_max - 1;
+    *class_waste = waste[k][m - 1];
+    unsigned j = m - 1;
+    for (;;) {
+        classes[k] = align_size(size_bucket_upper(buckets[j]) - 1, geometry->unit_size);
+        if (k == 0) {
+            break;
+        }
+        j = start[k][j] - 1;
+        k--;
+    }
+    return k_max;
+}
+
+void print_size_report(FILE* fp, SizeHistogram* histogram, PetGeometry* pet_geometry)
+{
+    uint64_t total_count = 0;
+    uint64_t total_bytes = 0;
+    for (unsigned i = 0; i < SIZE_PROFILE_NUM_BUCKETS; i++) {
+        total_count += histogram->count[i];
+        total_bytes += histogram->bytes[i];
+    }
+    fprintf(fp, "Allocation sizes: %" PRIu64 " blocks, %" PRIu64 " bytes requested\n\n", total_count, total_bytes);
+    if (!total_count) {
+        return;
+    }
+    fprintf(fp, "%23s %12s %7s %7s\n", "size range", "count", "%", "cum %");
+    uint64_t cumulative = 0;
+    for (unsigned i = 0; i < SIZE_PROFILE_NUM_BUCKETS; i++) {
+        uint64_t count = histogram->count[i];
+        if (count) {
+            cumulative += count;
+            fprintf(fp, "%10" PRIu64 " - %10" PRIu64 " %12" PRIu64 " %7.2f %7.2f\n",
+                    size_bucket_lower(i), size_bucket_upper(i) - 1, count,
+                    percent(count, total_count), percent(cumulative, total_count));
+        }
+    }
+
+    Geometry geometry;
+    make_geometry(pet_geometry->page_size, pet_geometry->unit_size, pet_geometry->bitmap_offset, &geometry);
+    Waste waste;
+    estimate_waste(histogram, &geometry, &waste);
+
+    fprintf(fp, "\nEstimated waste for page size %u, unit size %u, bitmap blocks up to %u bytes:\n",
+            geometry.page_size, geometry.unit_size, geometry.max_bitmap_block);
+    fprintf(fp, "  bitmap blocks  %12" PRIu64 " blocks %14" PRIu64 " bytes, unit rounding %.2f%%, page headers %.2f%%\n",
+            waste.small_blocks, waste.small_bytes,
+            percent(waste.small_rounding, waste.small_bytes), percent(waste.small_headers, waste.small_bytes));
+    fprintf(fp, "  direct mapped  %12" PRIu64 " blocks %14" PRIu64 " bytes, page rounding %.2f%%\n",
+            waste.large_blocks, waste.large_bytes, percent(waste.large_rounding, waste.large_bytes));
+    fprintf(fp, "  total waste    %.2f%% of requested bytes\n", percent(total_waste(&waste), total_bytes));
+
+    // other unit sizes
+    fprintf(fp, "\n%10s %14s %14s\n", "unit size", "max bitmap", "total waste");
+    unsigned best_unit = geometry.unit_size;
+    double best_waste = total_waste(&waste);
+    for (unsigned unit_size = 8; unit_size <= 128; unit_size *= 2) {
+        Geometry g;
+        make_geometry(geometry.page_size, unit_size, pet_geometry->bitmap_offset, &g);
+        Waste w;
+        estimate_waste(histogram, &g, &w);
+        fprintf(fp, "%10u %14u %13.2f%%%s\n", unit_size, g.max_bitmap_block, percent(total_waste(&w), total_bytes),
+                (unit_size < MIN_ALIGNMENT)? "  breaks 16-byte alignment" :
+                (unit_size == geometry.unit_size)? "  current" : "");
+        if (unit_size >= MIN_ALIGNMENT && total_waste(&w) < best_waste) {
+            best_unit = unit_size;
+            best_waste = total_waste(&w);
+        }
+    }
+    fprintf(fp, "Suggested unit size: %u\n", best_unit);
+
+    uint64_t classes[NUM_SIZE_CLASSES];
+    double class_waste;
+    unsigned num_classes = suggest_size_classes(histogram, &geometry, classes, &class_waste);
+    if (num_classes) {
+        fprintf(fp, "\nSuggested size classes for bitmap blocks:");
+        for (unsigned i = 0; i < num_classes; i++) {
+            fprintf(fp, " %" PRIu64, classes[i]);
+        }
+        fprintf(fp, "\n  rounding waste %.2f%% of bitmap block bytes, %.2f%% with unit rounding\n",
+                percent(class_waste, waste.small_bytes), percent(waste.small_rounding, waste.small_bytes));
+    }
+}
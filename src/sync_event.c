@@ -1,17 +1,80 @@
 #include <errno.h>
 
 #include "allocator.h"
+#include "lock_free_stack.h"
 #include "sync.h"
 #include "timespec.h"
+#include "usdt.h"
 
-Event* create_event()
+/*
+ * USDT probes, see usdt.h:
+ *
+ *   event_set         event
+ *   event_wait        event, timeout in microseconds or -1 for infinite wait
+ *   event_wait_done   event, result of wait_event
+ */
+USDT_SEMAPHORE(pussy, event_set);
+USDT_SEMAPHORE(pussy, event_wait);
+USDT_SEMAPHORE(pussy, event_wait_done);
+
+/****************************************************************
+ * Pool of released events.
+ *
+ * Events created with create_event are not returned to the allocator
+ * but kept in a lock-free stack for reuse, links are placed in the memory
+ * of finalized events. Threads take and give events through their caches
+ * in batches, caches are flushed to the stack when threads exit.
+ */
+
+#define EVENT_BATCH_SIZE  8
+
+static_assert(sizeof(Event) >= sizeof(StackNode));
+
+static LockFreeStack event_pool;  // zero-initialized stack is empty
+static thread_local StackCache event_cache;
+static thread_local bool event_cache_registered = false;
+static once_flag event_cache_key_once = ONCE_FLAG_INIT;
+static tss_t event_cache_key;
+static bool event_cache_key_created = false;
+
+static void flush_event_cache(void* cache)
+/*
+ * Thread exit handler.
+ */
 {
-    int err = 0;
-    Event* event = allocate(sizeof(Event), true);
-    if (!event) {
-        errno = ENOMEM;
-        return nullptr;
+    flush_stack_cache(cache, &event_pool);
+}
+
+static void create_event_cache_key()
+{
+    event_cache_key_created = tss_create(&event_cache_key, flush_event_cache) == thrd_success;
+}
+
+static StackCache* get_event_cache()
+{
+    if (!event_cache_registered) {
+        call_once(&event_cache_key_once, create_event_cache_key);
+        if (event_cache_key_created) {
+            tss_set(event_cache_key, &event_cache);
+        }
+        event_cache_registered = true;
     }
+    return &event_cache;
+}
+
+static void recycle_event(Event* event)
+{
+    cache_push(get_event_cache(), &event_pool, (StackNode*) event, EVENT_BATCH_SIZE);
+}
+
+/****************************************************************
+ * Public functions
+ */
+
+bool init_event(Event* event)
+{
+    int err = 0;
+    event->flag = false;
     switch (cnd_init(&event->cond)) {
         case thrd_success:
             break;
@@ -19,7 +82,8 @@ Event* create_event()
             err = ENOMEM;
             [[fallthrough]];
         default:
-            goto err;
+            errno = err;
+            return false;
     }
     switch (mtx_init(&event->mtx, mtx_timed | mtx_recursive)) {
         case thrd_success:
@@ -28,14 +92,36 @@ Event* create_event()
             err = ENOMEM;
             [[fallthrough]];
         default:
-            goto err;
+            cnd_destroy(&event->cond);
+            errno = err;
+            return false;
     }
-    return event;
+    return true;
+}
 
-err:
-    release((void**) &event, sizeof(Event));
-    errno = err;
-    return nullptr;
+void fini_event(Event* event)
+{
+    mtx_destroy(&event->mtx);
+    cnd_destroy(&event->cond);
+}
+
+Event* create_event()
+{
+    Event* event = (Event*) cache_pop(get_event_cache(), &event_pool);
+    if (!event) {
+        event = allocate(sizeof(Event), true);
+        if (!event) {
+            errno = ENOMEM;
+            return nullptr;
+        }
+    }
+    if (!init_event(event)) {
+        int err = errno;
+        recycle_event(event);
+        errno = err;
+        return nullptr;
+    }
+    return event;
 }
 
 void delete_event(Event** event_ptr)
@@ -45,16 +131,20 @@ void delete_event(Event** event_ptr)
     }
     Event* event = *event_ptr;
     if (event) {
-        mtx_destroy(&event->mtx);
-        cnd_destroy(&event->cond);
-        release((void**) &event, sizeof(Event));
+        fini_event(event);
+        recycle_event(event);
+        *event_ptr = nullptr;
     }
 }
 
 void set_event(Event* event)
 {
+    USDT_PROBE1(pussy, event_set, event);
+    // under the mutex, so the wakeup is not lost between the waiter's check of the flag and cnd_wait
+    mtx_lock(&event->mtx);
     event->flag = true;
     cnd_broadcast(&event->cond);
+    mtx_unlock(&event->mtx);
 }
 
 void clear_event(Event* event)
@@ -75,19 +165,25 @@ bool wait_event(Event* event, double timeout)
         mtx_unlock(&event->mtx);
         return true;
     }
+    USDT_PROBE2(pussy, event_wait, event, (timeout >= 0.0)? (int64_t) (timeout * 1e6) : -1);
+    // loop over spurious wakeups
     if (timeout >= 0.0) {
         struct timespec time_point;
         timespec_get(&time_point, TIME_UTC);
         timespec_add(&time_point, timeout);
 
-        if (cnd_timedwait(&event->cond, &event->mtx, &time_point) == thrd_timedout) {
-            signalled = false;
-        } else {
-            signalled = true;
+        while (!event->flag) {
+            if (cnd_timedwait(&event->cond, &event->mtx, &time_point) == thrd_timedout) {
+                break;
+            }
         }
     } else {
-        cnd_wait(&event->cond, &event->mtx);
+        while (!event->flag) {
+            cnd_wait(&event->cond, &event->mtx);
+        }
     }
+    signalled = event->flag;
     mtx_unlock(&event->mtx);
+    USDT_PROBE2(pussy, event_wait_done, event, signalled);
     return signalled;
 }
@@ -0,0 +1,169 @@
+/*
+ * Offline analyzer of pet_allocator heap snapshots.
+ *
+ * Usage: pet_snapshot_analyze snapshot_file
+ *
+ * Prints occupancy and fragmentation distributions.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "allocator.h"
+#include "pet_snapshot.h"
+
+static char* lifetime_names[PET_NUM_LIFETIMES] = { "transient", "persistent" };
+
+static inline bool get_bit(uint8_t* bitmap, unsigned i)
+{
+    return (bitmap[i / 8] >> (i & 7)) & 1;
+}
+
+static unsigned log2_bucket(unsigned n)
+{
+    return 31 - __builtin_clz(n);
+}
+
+static void print_histogram(char* title, char* label, uint64_t* counts, unsigned num_buckets,
+                            bool log_scale, uint64_t total)
+{
+    printf("\n%s:\n", title);
+    for (unsigned i = 0; i < num_buckets; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        if (log_scale) {
+            printf("  %s %6u..%-6u %10" PRIu64 "  %5.1f%%\n", label, 1U << i, (2U << i) - 1,
+                   counts[i], 100.0 * counts[i] / total);
+        } else {
+            printf("  %s %3u..%-3u%% %10" PRIu64 "  %5.1f%%\n", label, i * 10, (i < 9)? i * 10 + 9 : 100,
+                   counts[i], 100.0 * counts[i] / total);
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s snapshot_file\n", argv[0]);
+        return 1;
+    }
+    int fd = open(argv[1], O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(PetSnapshotHeader)) {
+        fprintf(stderr, "%s: bad snapshot file\n", argv[1]);
+        return 1;
+    }
+    uint8_t* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        return 1;
+    }
+    PetSnapshotHeader* header = (PetSnapshotHeader*) data;
+    size_t record_size = sizeof(PetSnapshotPage) + header->bitmap_size;
+    if (memcmp(header->magic, PET_SNAPSHOT_MAGIC, sizeof(PET_SNAPSHOT_MAGIC))
+        || header->version != PET_SNAPSHOT_VERSION
+        || header->header_units >= header->units_per_page
+        || header->units_per_page > (uint64_t) header->bitmap_size * 8
+        || header->num_pages > ((size_t) st.st_size - sizeof(PetSnapshotHeader)) / record_size) {
+        fprintf(stderr, "%s: bad snapshot file\n", argv[1]);
+        return 1;
+    }
+
+    unsigned data_units = header->units_per_page - header->header_units;
+
+    printf("Page size %u, unit size %u, data units per page %u\n",
+           header->page_size, header->unit_size, data_units);
+    printf("Bm pages: %" PRIu64 " (%" PRIu64 " in snapshot), blocks allocated: %" PRIu64 "\n",
+           header->num_bm_pages, header->num_pages, header->blocks_allocated);
+    printf("Large blocks: %" PRIu64 ", %" PRIu64 " bytes mapped\n",
+           header->num_large_blocks, header->large_mapped_bytes);
+
+    uint64_t occupancy[10] = {};
+    uint64_t lfb_buckets[32] = {};
+    uint64_t free_run_buckets[32] = {};
+    uint64_t free_run_units[32] = {};
+    uint64_t total_free = 0;
+    uint64_t total_lfb = 0;
+    uint64_t num_free_runs = 0;
+    uint64_t num_empty_lfb = 0;
+    uint64_t lifetime_pages[PET_NUM_LIFETIMES] = {};
+    uint64_t lifetime_free[PET_NUM_LIFETIMES] = {};
+
+    uint8_t* p = data + sizeof(PetSnapshotHeader);
+    for (uint64_t i = 0; i < header->num_pages; i++, p += record_size) {
+        PetSnapshotPage* page = (PetSnapshotPage*) p;
+        uint8_t* bitmap = p + sizeof(PetSnapshotPage);
+
+        unsigned num_free = 0;
+        unsigned run = 0;
+        for (unsigned u = header->header_units; u <= header->units_per_page; u++) {
+            if (u < header->units_per_page && !get_bit(bitmap, u)) {
+                num_free++;
+                run++;
+            } else if (run) {
+                unsigned b = log2_bucket(run);
+                free_run_buckets[b]++;
+                free_run_units[b] += run;
+                num_free_runs++;
+                run = 0;
+            }
+        }
+        unsigned used_percent = 100 * (data_units - num_free) / data_units;
+        occupancy[(used_percent < 100)? used_percent / 10 : 9]++;
+
+        if (page->lfb) {
+            lfb_buckets[log2_bucket(page->lfb)]++;
+        } else {
+            num_empty_lfb++;
+        }
+        total_free += num_free;
+        total_lfb += page->lfb;
+        if (page->lifetime < PET_NUM_LIFETIMES) {
+            lifetime_pages[page->lifetime]++;
+            lifetime_free[page->lifetime] += num_free;
+        }
+    }
+    uint64_t total_data = header->num_pages * data_units;
+    if (total_data == 0) {
+        printf("\nNo pages in snapshot\n");
+        return 0;
+    }
+
+    printf("\nData units: %" PRIu64 ", free: %" PRIu64 " (%.1f%%)\n", total_data, total_free, 100.0 * total_free / total_data);
+    for (unsigned i = 0; i < PET_NUM_LIFETIMES; i++) {
+        if (lifetime_pages[i]) {
+            printf("  %-10s pages: %" PRIu64 ", occupancy: %.1f%%\n", lifetime_names[i], lifetime_pages[i],
+                   100.0 - 100.0 * lifetime_free[i] / (lifetime_pages[i] * data_units));
+        }
+    }
+    if (total_free) {
+        /*
+         * Fragmentation is the share of free space that cannot be used
+         * for a block of size equal to the page's longest free block.
+         */
+        printf("Fragmentation: %.1f%%, free runs: %" PRIu64 ", average free run: %.1f units\n",
+               100.0 - 100.0 * total_lfb / total_free, num_free_runs, (double) total_free / num_free_runs);
+    }
+    print_histogram("Page occupancy (pages)", "used", occupancy, 10, false, header->num_pages);
+    if (num_empty_lfb) {
+        printf("\nFull pages: %" PRIu64 "\n", num_empty_lfb);
+    }
+    print_histogram("Longest free block (pages)", "units", lfb_buckets, 32, true, header->num_pages);
+    print_histogram("Free runs (runs)", "units", free_run_buckets, 32, true, num_free_runs);
+    print_histogram("Free runs (units)", "units", free_run_units, 32, true, total_free);
+
+    munmap(data, st.st_size);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Render pet_allocator heap snapshot as an image.
+ *
+ * Usage: pet_snapshot_image [-a] [-c] snapshot_file image_file
+ *
+ *   -a  order pages by address, default is by LFB as in snapshot
+ *   -c  write color PPM, default is grayscale PGM
+ *
+ * One row per page, one pixel per unit.
+ * PGM: allocated units are black, free are white, page header is gray.
+ * PPM: allocated units are red, free are green, page header is blue.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pet_snapshot.h"
+
+static uint8_t gray_free = 255;
+static uint8_t gray_used = 0;
+static uint8_t gray_header = 128;
+
+static uint8_t rgb_free[3]   = {  32, 192,  32 };
+static uint8_t rgb_used[3]   = { 208,  32,  32 };
+static uint8_t rgb_header[3] = {  32,  32, 160 };
+
+static uint8_t* records;
+static size_t record_size;
+
+static int compare_addr(const void* a, const void* b)
+{
+    uint64_t addr_a = ((PetSnapshotPage*) (records + *(size_t*) a * record_size))->addr;
+    uint64_t addr_b = ((PetSnapshotPage*) (records + *(size_t*) b * record_size))->addr;
+    return (addr_a > addr_b) - (addr_a < addr_b);
+}
+
+int main(int argc, char* argv[])
+{
+    bool by_addr = false;
+    bool color = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "ac")) != -1) {
+        switch (opt) {
+            case 'a': by_addr = true; break;
+            case 'c': color = true; break;
+            default: goto usage;
+        }
+    }
+    if (argc - optind != 2) {
+        goto usage;
+    }
+    char* snapshot_file = argv[optind];
+    char* image_file = argv[optind + 1];
+
+    int fd = open(snapshot_file, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "%s: %s\n", snapshot_file, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(PetSnapshotHeader)) {
+        fprintf(stderr, "%s: bad snapshot file\n", snapshot_file);
+        return 1;
+    }
+    uint8_t* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        return 1;
+    }
+    close(fd);
+
+    PetSnapshotHeader* header = (PetSnapshotHeader*) data;
+    record_size = sizeof(PetSnapshotPage) + header->bitmap_size;
+    if (memcmp(header->magic, PET_SNAPSHOT_MAGIC, sizeof(PET_SNAPSHOT_MAGIC))
+        || header->version != PET_SNAPSHOT_VERSION
+        || header->header_units >= header->units_per_page
+        || header->units_per_page > (uint64_t) header->bitmap_size * 8
+        || header->num_pages > ((size_t) st.st_size - sizeof(PetSnapshotHeader)) / record_size) {
+        fprintf(stderr, "%s: bad snapshot file\n", snapshot_file);
+        return 1;
+    }
+    records = data + sizeof(PetSnapshotHeader);
+    madvise(data, st.st_size, by_addr? MADV_RANDOM : MADV_SEQUENTIAL);
+
+    size_t num_pages = header->num_pages;
+    size_t* order = malloc(num_pages * sizeof(size_t));
+    for (size_t i = 0; i < num_pages; i++) {
+        order[i] = i;
+    }
+    if (by_addr) {
+        qsort(order, num_pages, sizeof(size_t), compare_addr);
+    }
+
+    /*
+     * Expand bitmap bytes to pixels with lookup table:
+     * 8 pixels per byte, each pixel is 1 or 3 bytes.
+     */
+    unsigned pixel_size = color? 3 : 1;
+    unsigned width = header->units_per_page;
+    uint8_t* lut = malloc(256 * 8 * pixel_size);
+    for (unsigned b = 0; b < 256; b++) {
+        for (unsigned j = 0; j < 8; j++) {
+            uint8_t* pixel = lut + (b * 8 + j) * pixel_size;
+            bool used = (b >> j) & 1;
+            if (color) {
+                memcpy(pixel, used? rgb_used : rgb_free, 3);
+            } else {
+                *pixel = used? gray_used : gray_free;
+            }
+        }
+    }
+    size_t row_size = (size_t) width * pixel_size;
+    uint8_t* row = malloc(header->bitmap_size * 8 * pixel_size);
+
+    FILE* fp = fopen(image_file, "w");
+    if (!fp) {
+        fprintf(stderr, "%s: %s\n", image_file, strerror(errno));
+        return 1;
+    }
+    static char iobuf[1 << 20];
+    setvbuf(fp, iobuf, _IOFBF, sizeof(iobuf));
+    fprintf(fp, "%s\n%u %zu\n255\n", color? "P6" : "P5", width, num_pages);
+
+    for (size_t i = 0; i < num_pages; i++) {
+        uint8_t* bitmap = records + order[i] * record_size + sizeof(PetSnapshotPage);
+        uint8_t* p = row;
+        for (unsigned j = 0; j < header->bitmap_size; j++) {
+            memcpy(p, lut + bitmap[j] * 8 * pixel_size, 8 * pixel_size);
+            p += 8 * pixel_size;
+        }
+        // header units are marked as used in the bitmap, show them differently
+        for (unsigned j = 0; j < header->header_units; j++) {
+            if (color) {
+                memcpy(row + j * 3, rgb_header, 3);
+            } else {
+                row[j] = gray_header;
+            }
+        }
+        fwrite(row, 1, row_size, fp);
+    }
+    if (fclose(fp)) {
+        fprintf(stderr, "%s: %s\n", image_file, strerror(errno));
+        return 1;
+    }
+    free(row);
+    free(lut);
+    free(order);
+    munmap(data, st.st_size);
+    return 0;
+
+usage:
+    fprintf(stderr, "Usage: %s [-a] [-c] snapshot_file image_file\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,131 @@
+/*
+ * Reader of pet_allocator stats published with pet_publish_stats.
+ *
+ * Usage: pet_stats_top name [interval [count]]
+ *
+ * Samples the shared memory segment every `interval` seconds (default 1)
+ * and prints counters and their rates. The process is never blocked by the reader.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pet_stats.h"
+#include "timespec.h"
+
+static void print_lifetimes(PetSharedStats* s)
+{
+    static char* names[PET_NUM_LIFETIMES] = { "transient", "persistent" };
+
+    printf("  pages:");
+    for (unsigned i = 0; i < PET_NUM_LIFETIMES; i++) {
+        // occupancy relative to the whole page, including its header
+        double capacity = (double) s->lifetime_pages[i] * s->page_size / s->unit_size;
+        printf(" %s %" PRIu64 " (%.1f%% used)", names[i], s->lifetime_pages[i],
+               capacity? 100.0 * s->lifetime_units[i] / capacity : 0.0);
+    }
+    putchar('\n');
+}
+
+static void print_lfb_summary(PetSharedStats* s)
+{
+    // number of pages grouped by log2 of the longest free block
+    uint64_t buckets[32] = {};
+    for (unsigned i = 1; i < s->num_lfb_buckets; i++) {
+        buckets[31 - __builtin_clz(i)] += s->lfb_population[i];
+    }
+    printf("  LFB:");
+    if (s->lfb_population[0]) {
+        printf(" full:%u", s->lfb_population[0]);
+    }
+    for (unsigned i = 0; i < 32; i++) {
+        if (buckets[i]) {
+            printf(" %u+:%" PRIu64, 1U << i, buckets[i]);
+        }
+    }
+    putchar('\n');
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s name [interval [count]]\n", argv[0]);
+        return 1;
+    }
+    double interval = (argc > 2)? strtod(argv[2], nullptr) : 1.0;
+    unsigned long count = (argc > 3)? strtoul(argv[3], nullptr, 10) : 0;
+
+    int fd = shm_open(argv[1], O_RDONLY, 0);
+    if (fd == -1) {
+        fprintf(stderr, "shm_open(%s): %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(PetSharedStats)) {
+        fprintf(stderr, "%s: bad stats segment\n", argv[1]);
+        return 1;
+    }
+    size_t size = st.st_size;
+    PetSharedStats* shared = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "mmap: %s\n", strerror(errno));
+        return 1;
+    }
+    close(fd);
+
+    PetSharedStats* current = malloc(size);
+    PetSharedStats* prev = malloc(size);
+    if (!pet_read_shared_stats(shared, prev, size)) {
+        fprintf(stderr, "%s: stale stats segment, update never completes\n", argv[1]);
+        return 1;
+    }
+
+    struct timespec prev_time;
+    timespec_get(&prev_time, TIME_UTC);
+
+    for (unsigned long n = 0; count == 0 || n < count; n++) {
+        struct timespec delay = {};
+        timespec_add(&delay, interval);
+        thrd_sleep(&delay, nullptr);
+
+        if (!pet_read_shared_stats(shared, current, size)) {
+            printf("stale stats segment, update never completes\n");
+            fflush(stdout);
+            continue;
+        }
+        struct timespec now, elapsed;
+        timespec_get(&now, TIME_UTC);
+        elapsed = now;
+        timespec_sub(&elapsed, &prev_time);
+        double dt = elapsed.tv_sec + elapsed.tv_nsec / 1e9;
+
+        printf("blocks %" PRIu64 " (%+.0f/s), bm pages %" PRIu64 ", large %" PRIu64
+               ", mapped %.1f MB, locks %.0f/s, contended %.0f/s\n",
+               current->blocks_allocated,
+               ((double) current->blocks_allocated - prev->blocks_allocated) / dt,
+               current->num_bm_pages, current->num_large_blocks,
+               current->mapped_bytes / 1048576.0,
+               (current->lock_acquisitions - prev->lock_acquisitions) / dt,
+               (current->lock_contentions - prev->lock_contentions) / dt);
+        print_lifetimes(current);
+        print_lfb_summary(current);
+        fflush(stdout);
+
+        PetSharedStats* tmp = prev;
+        prev = current;
+        current = tmp;
+        prev_time = now;
+    }
+    free(current);
+    free(prev);
+    munmap(shared, size);
+    return 0;
+}